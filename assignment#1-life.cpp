@@ -8,6 +8,11 @@
 #include <fstream>   // for ifstream
 #include <unistd.h>  // for Sleep(us)
 #include <cmath>     // for min, max
+#include <cstdint>   // for uint8_t, uint32_t
+#include <cstring>   // for memset
+#include <algorithm> // for sort, unique
+#include <vector>    // for the scratch rows and the chunk pool
+#include <unordered_map> // for the chunks of the universe
 using namespace std;
 
 #include "console.h" // required of all files that contain the main function
@@ -18,16 +23,120 @@ using namespace std;
 #include "life-constants.h"  // for kMaxAge
 #include "life-graphics.h"   // for class LifeDisplay
 
+/**
+ * Type: LifeRule
+ * --------------
+ * A Life-like rule in B/S notation, e.g. "B36/S23": a dead cell is born
+ * with any neighbour count after the B, and a live cell survives with any
+ * count after the S.  Bit n of each mask stands for n neighbours.
+ */
+struct LifeRule {
+    uint32_t birth;
+    uint32_t survival;
+    bool isValid;
+};
+
+static constexpr bool operator==(const LifeRule& one, const LifeRule& two) {
+    return one.birth == two.birth && one.survival == two.survival;
+}
+
+/**
+ * Function: parseLifeRule
+ * -----------------------
+ * Parse a B/S rulestring, in either case; isValid is false if it isn't
+ * one.  It can run at compile time, so the rules below are constants.
+ */
+static constexpr LifeRule parseLifeRule(const char* text) {
+    LifeRule rule {0, 0, false};
+    int i = 0;
+    if (text[i] != 'B' && text[i] != 'b') return rule;
+    for (i++; text[i] >= '0' && text[i] <= '8'; i++) {
+        rule.birth |= 1u << (text[i] - '0');
+    }
+    if (text[i++] != '/') return rule;
+    if (text[i] != 'S' && text[i] != 's') return rule;
+    for (i++; text[i] >= '0' && text[i] <= '8'; i++) {
+        rule.survival |= 1u << (text[i] - '0');
+    }
+    rule.isValid = text[i] == '\0';
+    return rule;
+}
+
+// the rules with kernels of their own, every other rule uses the generic one
+static constexpr LifeRule kConway = parseLifeRule("B3/S23");
+static constexpr LifeRule kHighLife = parseLifeRule("B36/S23");
+static constexpr LifeRule kDayAndNight = parseLifeRule("B3678/S34678");
+static constexpr LifeRule kSeeds = parseLifeRule("B2/S");
+static constexpr LifeRule kLifeWithoutDeath = parseLifeRule("B3/S012345678");
+
+/**
+ * Type: StaticLifeRule
+ * --------------------
+ * One of the rules above as a type, so a kernel instantiated with it sees
+ * its masks as compile-time constants.
+ */
+template <const LifeRule& Rule>
+struct StaticLifeRule {
+    static constexpr uint32_t birth = Rule.birth;
+    static constexpr uint32_t survival = Rule.survival;
+};
+
+/**
+ * Type: LifeChunk
+ * ---------------
+ * A kChunkSize x kChunkSize square of the unbounded universe, holding the
+ * age of every cell.
+ */
+static const int kChunkShift = 4;
+static const int kChunkSize = 1 << kChunkShift;
+
+struct LifeChunk {
+    uint8_t ages[kChunkSize][kChunkSize];
+    int population;
+};
+
+/**
+ * Type: LifeUniverse
+ * ------------------
+ * A colony with no edges.  Only the chunks holding live cells exist, found
+ * by their position in a hash map; they come from a pool and go back to it
+ * as soon as they empty, so memory follows the population however far a
+ * spaceship travels.  Row and column 0 are the top left of the board the
+ * colony was read from.
+ */
+struct LifeUniverse {
+    unordered_map<uint64_t, int> chunks;    // by chunk position, the index into pool
+    vector<LifeChunk> pool;
+    vector<int> freeChunks;                 // indexes of the pool not in use
+    long long population = 0;
+};
+
 // function prototype
+#ifndef BENCHMARK
 static void welcome();
+#endif
 ifstream openFile(LifeDisplay& display);
 void getStart(int& row, int& column, Grid<int>& matrix, ifstream& input);
 void matrixToDisplay(int row, int column, Grid<int> matrix, LifeDisplay& display);
-bool generateToNext(int row, int column, Grid<int>& currentMatrix, Grid<int>& previousMatrix);
+LifeRule getRule();
+bool generateToNext(int row, int column, Grid<int>& currentMatrix, Grid<int>& previousMatrix,
+                    const LifeRule& rule = kConway);
+template <typename Rule>
+bool generateWithRule(const Rule& rule, int row, int column, Grid<int>& currentMatrix, Grid<int>& previousMatrix);
+template <typename Kernel>
+auto withLifeRule(const LifeRule& rule, Kernel kernel);
+LifeUniverse makeUniverse(int row, int column, const Grid<int>& matrix);
+void setUniverseCell(LifeUniverse& universe, int row, int column, int age);
+int getUniverseCell(const LifeUniverse& universe, int row, int column);
+void universeToDisplay(const LifeUniverse& universe, int row, int column, LifeDisplay& display);
+bool generateUniverse(LifeUniverse& universe, const LifeRule& rule);
+template <typename Rule>
+bool generateUniverseWithRule(const Rule& rule, LifeUniverse& universe);
 int excecutionMode();
 bool generationGap(int modeCode);
 
 
+#ifndef BENCHMARK
 /**
  * Function: main
  * --------------
@@ -58,16 +167,28 @@ int main() {
         matrixToDisplay(row, column, currentMatrix, display);
         display.repaint();
 
-        // prompt the user to input the speed mode
+        // prompt the user to input the rule and the speed mode
+        LifeRule rule = getRule();
         int modeCode = excecutionMode();
 
-        // go to the next generation
-        while(!generateToNext(row, column, currentMatrix, previousMatrix)) {
-            if (!generationGap(modeCode)) {
-                break;
+        // go to the next generation, on the board or past its edges
+        if (getYesOrNo("Should the colony grow past the edges of the board? ")) {
+            LifeUniverse universe = makeUniverse(row, column, currentMatrix);
+            while(!generateUniverse(universe, rule)) {
+                if (!generationGap(modeCode)) {
+                    break;
+                }
+                universeToDisplay(universe, row, column, display);
+                display.repaint();
+            }
+        } else {
+            while(!generateToNext(row, column, currentMatrix, previousMatrix, rule)) {
+                if (!generationGap(modeCode)) {
+                    break;
+                }
+                matrixToDisplay(row, column, currentMatrix, display);
+                display.repaint();
             }
-            matrixToDisplay(row, column, currentMatrix, display);
-            display.repaint();
         }
 
         // ask the user weather to continue
@@ -84,18 +205,22 @@ int main() {
 /**
  * Function: welcome
  * -----------------
- * Introduces the user to the Game of Life and its rules.
+ * Introduces the user to the Game of Life, Conway's rules and the rule prompt.
  */
 static void welcome() {
     cout << "Welcome to the game of Life, a simulation of the lifecycle of a bacteria colony." << endl;
-    cout << "Cells live and die by the following rules:" << endl << endl;
+    cout << "By default cells live and die by Conway's rules, B3/S23:" << endl << endl;
     cout << "\tA cell with 1 or fewer neighbors dies of loneliness" << endl;
     cout << "\tLocations with 2 neighbors remain stable" << endl;
     cout << "\tLocations with 3 neighbors will spontaneously create life" << endl;
     cout << "\tLocations with 4 or more neighbors die of overcrowding" << endl << endl;
+    cout << "After loading a colony you can enter other rules in B/S notation: the neighbor" << endl;
+    cout << "counts that create life after the B, and those that keep a cell alive after the S." << endl;
+    cout << "HighLife, for example, is B36/S23." << endl << endl;
     cout << "In the animation, new cells are dark and fade to gray as they age." << endl << endl;
     getLine("Hit [enter] to continue....   ");
 }
+#endif
 
 
 ifstream openFile(LifeDisplay& display) {
@@ -160,55 +285,337 @@ void matrixToDisplay(int row, int column, Grid<int> matrix, LifeDisplay& display
 }
 
 
-bool generateToNext(int row, int column, Grid<int>& currentMatrix, Grid<int>& previousMatrix) {
-    // initialize the bool and num
-    bool isStable = false;
-    int changedNum = 0;
+/**
+ * Function: getRule
+ * -----------------
+ * Prompt the user for the rule in B/S notation, Conway's by default.
+ */
+LifeRule getRule() {
+    while (true) {
+        string text = trim(getLine("Enter the rule, e.g. B36/S23 [return for Conway's B3/S23]: "));
+        if (text.empty()) return kConway;
+        LifeRule rule = parseLifeRule(text.c_str());
+        if (rule.isValid) return rule;
+        cout << "A rule looks like B3/S23: the neighbour counts for a birth, then for survival." << endl;
+    }
+}
+
+
+/**
+ * Function: withLifeRule
+ * ----------------------
+ * Call the kernel with the rule as a StaticLifeRule if it has a kernel of
+ * its own, otherwise with the rule itself, and return what it returns.
+ */
+template <typename Kernel>
+auto withLifeRule(const LifeRule& rule, Kernel kernel) {
+    if (rule == kConway) {
+        return kernel(StaticLifeRule<kConway>());
+    } else if (rule == kHighLife) {
+        return kernel(StaticLifeRule<kHighLife>());
+    } else if (rule == kDayAndNight) {
+        return kernel(StaticLifeRule<kDayAndNight>());
+    } else if (rule == kSeeds) {
+        return kernel(StaticLifeRule<kSeeds>());
+    } else if (rule == kLifeWithoutDeath) {
+        return kernel(StaticLifeRule<kLifeWithoutDeath>());
+    }
+    return kernel(rule);
+}
 
+
+/**
+ * Function: generateToNext
+ * ------------------------
+ * Advance the colony one generation under the rule and return whether
+ * nothing changed.
+ */
+bool generateToNext(int row, int column, Grid<int>& currentMatrix, Grid<int>& previousMatrix,
+                    const LifeRule& rule) {
+    return withLifeRule(rule, [&](const auto& kernelRule) {
+        return generateWithRule(kernelRule, row, column, currentMatrix, previousMatrix);
+    });
+}
+
+
+/**
+ * Function: generateWithRule
+ * --------------------------
+ * The kernel behind generateToNext, for a StaticLifeRule or a LifeRule
+ * read at run time.  The live cells are first copied as 0/1 bytes into a
+ * board with a dead border, so each row's neighbour counts are plain sums
+ * of three rows with no bounds to check.  A cell that lives on ages by
+ * one, up to kMaxAge; any other cell is 0.
+ */
+template <typename Rule>
+bool generateWithRule(const Rule& rule, int row, int column, Grid<int>& currentMatrix, Grid<int>& previousMatrix) {
     // reassign the martix (a deep, full copy)
     previousMatrix = currentMatrix;
 
-    // the real generrate part (loop each cell)
+    // the live cells, with a border of dead ones all around
+    static vector<uint8_t> alive;
+    static vector<uint8_t> counts;
+    int width = column + 2;
+    alive.assign((size_t) (row + 2) * width, 0);
+    counts.resize(column);
+    for (int i = 0; i < row; i++) {
+        uint8_t* cells = &alive[(size_t) (i + 1) * width + 1];
+        for (int j = 0; j < column; j++) {
+            cells[j] = previousMatrix[i][j] > 0;
+        }
+    }
+
+    int changedNum = 0;
+    for (int i = 0; i < row; i++) {
+        // get the amont of neighbors of every cell in the row
+        const uint8_t* above = &alive[(size_t) i * width];
+        const uint8_t* here = above + width;
+        const uint8_t* below = here + width;
+        for (int j = 0; j < column; j++) {
+            counts[j] = above[j] + above[j + 1] + above[j + 2] + here[j] + here[j + 2]
+                      + below[j] + below[j + 1] + below[j + 2];
+        }
+
+        // according to the rule, generate the new age of the cell
+        for (int j = 0; j < column; j++) {
+            int age = previousMatrix[i][j];
+            uint32_t mask = here[j + 1] ? rule.survival : rule.birth;
+            int nextAge = (mask >> counts[j]) & 1 ? min(age + 1, kMaxAge) : 0;
+            if (nextAge != age) {
+                currentMatrix[i][j] = nextAge;
+                changedNum++;
+            }
+        }
+    }
+
+    // the colony is stable once no cell changed
+    return changedNum == 0;
+}
+
+
+// The key of the chunk at the chunk row and column
+static inline uint64_t getChunkKey(int chunkRow, int chunkColumn) {
+    return (uint64_t) (uint32_t) chunkRow << 32 | (uint32_t) chunkColumn;
+}
+
+// The index of the chunk in the pool, or -1 if it has no live cells
+static inline int findChunk(const LifeUniverse& universe, int chunkRow, int chunkColumn) {
+    auto found = universe.chunks.find(getChunkKey(chunkRow, chunkColumn));
+    return found == universe.chunks.end() ? -1 : found->second;
+}
+
+// Take an empty chunk from the pool, growing it if none is free
+static int allocateChunk(LifeUniverse& universe) {
+    int index;
+    if (universe.freeChunks.empty()) {
+        index = universe.pool.size();
+        universe.pool.emplace_back();
+    } else {
+        index = universe.freeChunks.back();
+        universe.freeChunks.pop_back();
+    }
+    LifeChunk& chunk = universe.pool[index];
+    memset(chunk.ages, 0, sizeof(chunk.ages));
+    chunk.population = 0;
+    return index;
+}
+
+
+/**
+ * Function: makeUniverse
+ * ----------------------
+ * Build the unbounded universe holding the colony of the board.
+ */
+LifeUniverse makeUniverse(int row, int column, const Grid<int>& matrix) {
+    LifeUniverse universe;
+    for (int i = 0; i < row; i++) {
+        for (int j = 0; j < column; j++) {
+            if (matrix[i][j] > 0) setUniverseCell(universe, i, j, matrix[i][j]);
+        }
+    }
+    return universe;
+}
+
+
+/**
+ * Function: setUniverseCell
+ * -------------------------
+ * Set the age of one cell, 0 for a dead one, allocating or freeing its
+ * chunk as needed.
+ */
+void setUniverseCell(LifeUniverse& universe, int row, int column, int age) {
+    uint64_t key = getChunkKey(row >> kChunkShift, column >> kChunkShift);
+    auto found = universe.chunks.find(key);
+    if (found == universe.chunks.end()) {
+        if (age == 0) return;
+        found = universe.chunks.emplace(key, allocateChunk(universe)).first;
+    }
+    LifeChunk& chunk = universe.pool[found->second];
+    uint8_t& cell = chunk.ages[row & (kChunkSize - 1)][column & (kChunkSize - 1)];
+    int change = (age > 0) - (cell > 0);
+    chunk.population += change;
+    universe.population += change;
+    cell = min(age, kMaxAge);
+    if (chunk.population == 0) {
+        universe.freeChunks.push_back(found->second);
+        universe.chunks.erase(found);
+    }
+}
+
+
+/**
+ * Function: getUniverseCell
+ * -------------------------
+ * Return the age of one cell, 0 if it is dead.
+ */
+int getUniverseCell(const LifeUniverse& universe, int row, int column) {
+    int index = findChunk(universe, row >> kChunkShift, column >> kChunkShift);
+    if (index == -1) return 0;
+    return universe.pool[index].ages[row & (kChunkSize - 1)][column & (kChunkSize - 1)];
+}
+
+
+/**
+ * Function: universeToDisplay
+ * ---------------------------
+ * Draw the part of the universe that the board covers.
+ */
+void universeToDisplay(const LifeUniverse& universe, int row, int column, LifeDisplay& display) {
     for (int i = 0; i < row; i++) {
         for (int j = 0; j < column; j++) {
-            // get the amont of neighbors of the loop cell
-            int neighborNum = 0;
-            int minRow = max(i - 1, 0);
-            int maxRow = min(i + 1, row - 1);
-            int minColumn = max(j - 1, 0);
-            int maxColumn = min(j + 1, column - 1);
-            for (int r = minRow; r <= maxRow; r++) {
-                for (int c = minColumn; c <= maxColumn; c++) {
-                    if (!(r == i && c == j) && previousMatrix[r][c] > 0) {
-                        neighborNum++;
+            display.drawCellAt(i, j, getUniverseCell(universe, i, j));
+        }
+    }
+}
+
+
+/**
+ * Function: generateUniverse
+ * --------------------------
+ * Advance the unbounded colony one generation under the rule and return
+ * whether nothing changed.
+ */
+bool generateUniverse(LifeUniverse& universe, const LifeRule& rule) {
+    return withLifeRule(rule, [&](const auto& kernelRule) {
+        return generateUniverseWithRule(kernelRule, universe);
+    });
+}
+
+
+/**
+ * Function: generateUniverseWithRule
+ * ----------------------------------
+ * The kernel behind generateUniverse.  Every chunk with live cells is
+ * computed again, along with the neighbouring chunks that live cells on
+ * its edge could bring to life.  Each is worked out like a small board:
+ * its live cells and the ring around them from the eight chunks next to
+ * it go into a (kChunkSize + 2)-square window, and the neighbour counts
+ * come from that.  A rule with a birth on 0 neighbours would fill the
+ * whole plane, so it only acts next to live cells here.
+ */
+template <typename Rule>
+bool generateUniverseWithRule(const Rule& rule, LifeUniverse& universe) {
+    static const int kWindowSize = kChunkSize + 2;
+
+    // the chunks to compute: every live one, and its neighbours that live edge cells reach
+    vector<uint64_t> candidates;
+    auto addCandidate = [&](int chunkRow, int chunkColumn) {
+        if (findChunk(universe, chunkRow, chunkColumn) == -1) candidates.push_back(getChunkKey(chunkRow, chunkColumn));
+    };
+    for (const auto& entry : universe.chunks) {
+        int chunkRow = (int) (entry.first >> 32);
+        int chunkColumn = (int) (uint32_t) entry.first;
+        const LifeChunk& chunk = universe.pool[entry.second];
+        candidates.push_back(entry.first);
+        for (int dr = -1; dr <= 1; dr++) {
+            for (int dc = -1; dc <= 1; dc++) {
+                if (dr == 0 && dc == 0) continue;
+                int fromRow = dr > 0 ? kChunkSize - 1 : 0;
+                int toRow = dr < 0 ? 1 : kChunkSize;
+                int fromColumn = dc > 0 ? kChunkSize - 1 : 0;
+                int toColumn = dc < 0 ? 1 : kChunkSize;
+                bool isReached = false;
+                for (int i = fromRow; i < toRow && !isReached; i++) {
+                    for (int j = fromColumn; j < toColumn && !isReached; j++) {
+                        isReached = chunk.ages[i][j] > 0;
                     }
                 }
+                if (isReached) addCandidate(chunkRow + dr, chunkColumn + dc);
             }
+        }
+    }
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
 
-            // according to the rule, generate the new age of the cell
-            if (neighborNum <= 1) {                                                // 0 or 1 neighbors
-                currentMatrix[i][j] = 0;
-            } else if (neighborNum == 2 && previousMatrix[i][j] > 0) {             // 2 neighbors
-                currentMatrix[i][j] = min(previousMatrix[i][j] + 1, kMaxAge);
-            } else if (neighborNum == 3) {                                         // 3 neighbors
-                currentMatrix[i][j] = min(previousMatrix[i][j] + 1, kMaxAge);
-            } else if (neighborNum >= 4 && previousMatrix[i][j] > 0) {             // 4 or more neighbors
-                currentMatrix[i][j] = 0;
+    // compute the next generation of every candidate into fresh chunks
+    unordered_map<uint64_t, int> nextChunks;
+    nextChunks.reserve(candidates.size());
+    uint8_t window[kWindowSize][kWindowSize];
+    int changedNum = 0;
+    long long population = 0;
+    for (uint64_t key : candidates) {
+        int chunkRow = (int) (key >> 32);
+        int chunkColumn = (int) (uint32_t) key;
+
+        // the live cells of the chunk and the ring around it
+        memset(window, 0, sizeof(window));
+        for (int dr = -1; dr <= 1; dr++) {
+            for (int dc = -1; dc <= 1; dc++) {
+                int index = findChunk(universe, chunkRow + dr, chunkColumn + dc);
+                if (index == -1) continue;
+                const LifeChunk& neighbour = universe.pool[index];
+                int fromRow = dr < 0 ? kChunkSize - 1 : 0;
+                int rowCount = dr == 0 ? kChunkSize : 1;
+                int toRow = dr < 0 ? 0 : (dr == 0 ? 1 : kChunkSize + 1);
+                int fromColumn = dc < 0 ? kChunkSize - 1 : 0;
+                int columnCount = dc == 0 ? kChunkSize : 1;
+                int toColumn = dc < 0 ? 0 : (dc == 0 ? 1 : kChunkSize + 1);
+                for (int i = 0; i < rowCount; i++) {
+                    for (int j = 0; j < columnCount; j++) {
+                        window[toRow + i][toColumn + j] = neighbour.ages[fromRow + i][fromColumn + j] > 0;
+                    }
+                }
             }
+        }
 
-            // confirm if the cell age is changed
-            if (previousMatrix[i][j] != currentMatrix[i][j]) {
-                changedNum++;
+        // allocating may move the pool, so the old chunk is only looked up afterwards
+        int nextIndex = allocateChunk(universe);
+        int index = findChunk(universe, chunkRow, chunkColumn);
+        LifeChunk& next = universe.pool[nextIndex];
+        for (int i = 0; i < kChunkSize; i++) {
+            const uint8_t* above = window[i];
+            const uint8_t* here = window[i + 1];
+            const uint8_t* below = window[i + 2];
+            for (int j = 0; j < kChunkSize; j++) {
+                int count = above[j] + above[j + 1] + above[j + 2] + here[j] + here[j + 2]
+                          + below[j] + below[j + 1] + below[j + 2];
+                int age = index == -1 ? 0 : universe.pool[index].ages[i][j];
+                uint32_t mask = here[j + 1] ? rule.survival : rule.birth;
+                int nextAge = (mask >> count) & 1 ? min(age + 1, kMaxAge) : 0;
+                next.ages[i][j] = nextAge;
+                next.population += nextAge > 0;
+                changedNum += nextAge != age;
             }
         }
+
+        // a chunk left empty goes straight back to the pool
+        if (next.population == 0) {
+            universe.freeChunks.push_back(nextIndex);
+        } else {
+            nextChunks.emplace(key, nextIndex);
+            population += next.population;
+        }
     }
 
-    // compare the two grid and get the result
-    if (changedNum == 0) {
-        isStable = true;
+    // the old generation's chunks are free again
+    for (const auto& entry : universe.chunks) {
+        universe.freeChunks.push_back(entry.second);
     }
+    universe.chunks.swap(nextChunks);
+    universe.population = population;
 
-    return isStable;
+    // the colony is stable once no cell changed
+    return changedNum == 0;
 }
 
 
@@ -8,39 +8,60 @@
 using namespace std;
 
 #include "console.h"
-#include "lexicon.h"
 #include "strlib.h"
 #include "simpio.h"
 #include "queue.h"
 #include "vector.h"
 #include "set.h"
+#include "dictionary-image.h"
 
-static string getWord(const Lexicon& english, const string& prompt);
-static void generateLadder(const Lexicon& english, const string& start, const string& end);
+static void generateLadder(const Dictionary& english, const string& start, const string& end);
+#ifndef BENCHMARK
+static string getWord(const Dictionary& english, const string& prompt);
 static void playWordLadder();
-Set<string> getDiffWords(const Lexicon& english, const string& originWord);
+#endif
+Set<string> getDiffWords(const Dictionary& english, const string& originWord);
 
-static const string kEnglishLanguageDatafile = "res\\dictionary.txt";
+static const string kEnglishLanguageDatafile = "res/dictionary.txt";
+static const string kEnglishLanguageImage = "res/dictionary.dawg";
 
+#ifndef BENCHMARK
 int main() {
     cout << "Welcome to the CS106 word ladder application!" << endl << endl;
     playWordLadder();
     cout << "Thanks for playing!" << endl;
-    Lexicon english(kEnglishLanguageDatafile);
+    Dictionary english = loadDictionary(kEnglishLanguageImage, kEnglishLanguageDatafile);
     playWordLadder();
 
     return 0;
 }
 
-static string getWord(const Lexicon& english, const string& prompt) {
+static string getWord(const Dictionary& english, const string& prompt) {
     while (true) {
         string response = trim(toLowerCase(getLine(prompt)));
-        if (response.empty() || english.contains(response)) return response;
+        if (response.empty() || dictionaryContains(english, response)) return response;
         cout << "Your response needs to be an Enxglish word, so please try again." << endl;
     }
 }
 
-static void generateLadder(const Lexicon& english, const string& start, const string& end) {
+static void playWordLadder() {
+    Dictionary english = loadDictionary(kEnglishLanguageImage, kEnglishLanguageDatafile);
+    while (true) {
+        string start = getWord(english, "Please enter the source word [return to quit]: ");
+        if (start.empty()) break;
+        string end = getWord(english, "Please enter the destination word [return to quit]: ");
+        if (end.empty()) break;
+        if (start.length() != end.length()) {
+            cout << "The length of the two words is not same, please try again." << endl;
+            continue;
+        }
+        generateLadder(english, start, end);
+    }
+}
+
+#endif
+
+static void generateLadder(const Dictionary& english, const string& start, const string& end) {
     cout << "Here's where you'll search for a word ladder connecting \"" << start << "\" to \"" << end << "\"." << endl;
 
     if (start == end) {
@@ -96,35 +117,20 @@ static void generateLadder(const Lexicon& english, const string& start, const st
     cout << "No word ladder between \"" << start << "\" and \"" << end << "\" could be found." << endl;
 }
 
-static void playWordLadder() {
-    Lexicon english(kEnglishLanguageDatafile);
-    while (true) {
-        string start = getWord(english, "Please enter the source word [return to quit]: ");
-        if (start.empty()) break;
-        string end = getWord(english, "Please enter the destination word [return to quit]: ");
-        if (end.empty()) break;
-        if (start.length() != end.length()) {
-            cout << "The length of the two words is not same, please try again." << endl;
-            continue;
-        }
-        generateLadder(english, start, end);
-    }
-}
-
 // Generate word that changing one letter from the originWord
-Set<string> getDiffWords(const Lexicon& english, const string& originWord) {
+Set<string> getDiffWords(const Dictionary& english, const string& originWord) {
     // Declare a set to store all the diff words
     Set<string> diffWords;
 
     // Loop by the length of the origin word
-    for (int i = 0; i < originWord.length(); i++) {
+    for (int i = 0; i < (int) originWord.length(); i++) {
         // Copy a string to be replaced
         string substituteWord = originWord;
         // Loop all the charactor, replace all
         for (char j = 'a';  j <= 'z'; j++) {
             substituteWord[i] = j;
-            // Check if the substituted word is in the english lexicon
-            if (english.contains(substituteWord)) {
+            // Check if the substituted word is in the english dictionary
+            if (dictionaryContains(english, substituteWord)) {
                 diffWords.add(substituteWord);
             }
         }
@@ -19,12 +19,16 @@ using namespace std;
 #include "queue.h"
 
 void generateMaze(int dimension);
+Vector<wall> chooseRemovedWalls(int dimension, const Vector<wall>& walls);
 bool isNecessary(const wall& w, const Set<wall>& walls, const int dimension);
 Vector<wall> createAllWalls(int dimension);
+#ifndef BENCHMARK
 static int getMazeDimension(string prompt, int minDimension = 7, int maxDimension = 50);
+#endif
 
 
 
+#ifndef BENCHMARK
 int main() {
     while (true) {
         int dimension = getMazeDimension("What should the dimension of your maze be [0 to exit]? ");
@@ -46,6 +50,7 @@ static int getMazeDimension(string prompt, int minDimension, int maxDimension) {
              << maxDimension << ", inclusive." << endl;
     }
 }
+#endif
 
 void generateMaze(int dimension) {
     MazeGeneratorView maze;
@@ -56,6 +61,19 @@ void generateMaze(int dimension) {
     maze.addAllWalls(walls);
     maze.repaint();
 
+    // Knock down the walls in the order they were chosen
+    for (wall w : chooseRemovedWalls(dimension, walls)) {
+        maze.removeWall(w);
+        maze.repaint();
+    }
+
+    // For look
+    sleep(5);
+}
+
+
+// Choose the walls to remove, in order, so that every cell is reachable
+Vector<wall> chooseRemovedWalls(int dimension, const Vector<wall>& walls) {
     Vector<int> wallIndexArray;
     for (int i = 0; i < walls.size(); i++) {
         wallIndexArray.add(i);
@@ -76,11 +94,11 @@ void generateMaze(int dimension) {
         retainedWalls.add(shuffledWalls[i]);
     }
 
+    Vector<wall> removedWalls;
     for (wall w : shuffledWalls) {
         if (!isNecessary(w, retainedWalls, dimension)) {
-            maze.removeWall(w);
+            removedWalls.add(w);
             retainedWalls.remove(w);
-            maze.repaint();
             loopNum++;
         }
         if (loopNum == dimension * dimension - 1) {
@@ -88,8 +106,7 @@ void generateMaze(int dimension) {
         }
     }
 
-    // For look
-    sleep(5);
+    return removedWalls;
 }
 
 
@@ -9,52 +9,193 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <string_view>
+#include <functional>  // for hash
+#include <memory>      // for shared_ptr
+#include <cstdlib>     // for strtod
+#include <cmath>       // for isfinite
+#include <cstdint>     // for uint32_t, uint64_t
 #include <random>
+#include <fcntl.h>     // for open
+#include <sys/mman.h>  // for mmap
+#include <sys/stat.h>  // for fstat
+#include <unistd.h>    // for close
 using namespace std;
 
 #include "console.h"
-#include "simpio.h"   // for getLine
+#include "simpio.h"   // for getLine, getYesOrNo, getIntegerBetween
 #include "strlib.h"   // for toLowerCase, trim
-#include "map.h"      // in order to store the definition
+#include "vector.h"
+#include "stack.h"    // for the alias table work lists
+#include "queue.h"    // for the reachability search
+#include "set.h"
+#include "error.h"    // for error
 
 static const string kGrammarsDirectory = "res/grammars/";
 static const string kGrammarFileExtension = ".g";
+static const string kStartSymbol = "<start>";
+
+// Limits of the expected length iteration, beyond them the grammar diverges
+static const int kMaxLengthIterations = 10000;
+static const double kMaxExpectedLength = 1e8;
+static const double kLengthTolerance = 1e-9;
+
+// Limits of the derivation explorer, the counts grow doubly exponentially
+static const int kMaxExploredDepth = 12;
+static const int kMaxListedDerivations = 100;
+static const int kMaxSampledDerivations = 20;
+
+/**
+ * Type: NonterminalTable
+ * ----------------------
+ * A flat open-addressing hash table from nonterminal name to production
+ * index.  The names are views into the mapped grammar file, so inserting
+ * one never allocates; the slot array doubles once it is half full.
+ */
+class NonterminalTable {
+public:
+    int get(string_view name) const;            // -1 if the name is missing
+    bool containsKey(string_view name) const;
+    void put(string_view name, int value);
+    int size() const;
+
+private:
+    struct Slot {
+        string_view name;
+        int value = -1;
+    };
+    Vector<Slot> slots;
+    int count = 0;
+
+    int findSlot(string_view name) const;
+    void grow();
+};
+
+/**
+ * Type: Production
+ * ----------------
+ * One nonterminal of the grammar.  Its expansions are the range
+ * [first, first + count) of the flat expansion arrays in Grammar.
+ */
+struct Production {
+    int first = 0;
+    int count = 0;
+
+    // Filled in by analyzeGrammar
+    bool isReachable = false;
+    bool canTerminate = false;
+    double expectedLength = 0;
+};
+
+/**
+ * Type: Grammar
+ * -------------
+ * The compiled grammar.  Every expansion is a view into the memory-mapped
+ * .g file, and all per-expansion data lives in flat arrays indexed by the
+ * expansion number, so loading costs a handful of allocations in total.
+ * An expansion line may start with an optional weight in braces, e.g.
+ * "{1000} the <noun>"; lines without one get weight 1.  Each production
+ * carries a Walker/Vose alias table built from its weights.
+ */
+struct Grammar {
+    shared_ptr<const char> text;    // keeps the mapping alive, unmapped with the last copy
+    NonterminalTable index;
+    Vector<string_view> names;
+    Vector<Production> productions;
+
+    Vector<string_view> expansions;
+    Vector<double> weights;
+    Vector<double> probability;     // chance to keep column i
+    Vector<int> alias;              // column to use instead of i
+
+    // Filled in by analyzeGrammar: the references of expansion e are
+    // references[referenceStart[e]] up to references[referenceStart[e + 1]]
+    Vector<int> terminalLength;     // characters outside the nonterminals
+    Vector<int> referenceStart;
+    Vector<int> references;         // production index of each "<...>", -1 if undefined
+};
 
 static string getNormalizedFilename(string filename);
+#ifndef BENCHMARK
 static bool isValidGrammarFilename(string filename);
 static string getFileName();
-string getFirstNonterminal(const string& str);
+static void exploreDerivations(const Grammar& grammar);
+#endif
 int getRandomInt(int min, int max);
-Map<string, Vector<string>> getDefinition(string fileName);
-string getRandomExpansion(const Map<string, Vector<string>>& definition, const string nonterminal);
+double getRandomReal();
+string_view trimView(string_view text);
+bool getNextLine(string_view& text, string_view& line);
+double parseWeight(string_view& line);
+void buildAliasTable(Grammar& grammar, const Production& production);
+Grammar getDefinition(string fileName);
+void resolveReferences(Grammar& grammar);
+void analyzeGrammar(Grammar& grammar);
+int getRandomColumn(const Grammar& grammar, const Production& production);
+string_view getRandomExpansion(const Grammar& grammar, string_view nonterminal);
+string generateSentence(const Grammar& grammar);
 string generateSentence(string fileName);
 
+/**
+ * Type: BigCount
+ * --------------
+ * An unsigned integer of any size, enough to count the derivations of a
+ * grammar, which grow doubly exponentially with the depth.
+ */
+class BigCount {
+public:
+    BigCount(uint64_t value = 0);
+    bool isZero() const;
+    BigCount operator+(const BigCount& other) const;
+    BigCount operator-(const BigCount& other) const;    // other must not be larger
+    BigCount operator*(const BigCount& other) const;
+    bool operator<(const BigCount& other) const;
+    string toString() const;
+    static BigCount randomBelow(const BigCount& bound);
+
+private:
+    Vector<uint32_t> limbs;                             // least significant first
+    void trim();
+};
+
+/**
+ * Type: DerivationCounts
+ * ----------------------
+ * count[d][p] is the number of derivation trees of production p whose
+ * height is at most d; a nonterminal costs one level, so count[0] is all
+ * zeros.  Built one depth level at a time, each level from the one below.
+ */
+struct DerivationCounts {
+    Vector<Vector<BigCount>> count;
+};
+
+DerivationCounts countDerivations(const Grammar& grammar, int maxDepth);
+BigCount countExpansion(const Grammar& grammar, const DerivationCounts& counts, int expansion, int depth);
+void enumerateDerivations(const Grammar& grammar, const DerivationCounts& counts, int depth,
+                          const function<bool(const string&)>& visit);
+string sampleDerivation(const Grammar& grammar, const DerivationCounts& counts, int depth);
+
+#ifndef BENCHMARK
 int main() {
     while (true) {
         string filename = getFileName();
         if (filename.empty()) break;
 
+        // Compile the grammar once for all three sentences
+        Grammar grammar = getDefinition(getNormalizedFilename(filename));
         for (int i = 1; i <= 3; i++) {
-            string sentence = generateSentence(filename);
+            string sentence = generateSentence(grammar);
             cout << i << ".) " << sentence << endl << endl;
         }
 
         cout << "Here's where you read in the \"" << filename << "\" grammar "
              << "and generate three random sentences." << endl << endl;
+        if (getYesOrNo("Do you want to explore its derivations? ")) exploreDerivations(grammar);
     }
     cout << "Thanks for playing!" << endl;
 
     return 0;
 }
 
-
-static string getNormalizedFilename(string filename) {
-    string normalizedFileName = kGrammarsDirectory + filename;
-    if (!endsWith(normalizedFileName, kGrammarFileExtension))
-        normalizedFileName += kGrammarFileExtension;
-    return normalizedFileName;
-}
-
 static bool isValidGrammarFilename(string filename) {
     string normalizedFileName = getNormalizedFilename(filename);
     ifstream infile(normalizedFileName.c_str());
@@ -69,70 +210,494 @@ static string getFileName() {
     }
 }
 
+/**
+ * Function: exploreDerivations
+ * ----------------------------
+ * Counts the derivations of <start> up to a height the user picks, then
+ * lists the first of them in order or draws some uniformly at random.
+ */
+static void exploreDerivations(const Grammar& grammar) {
+    int depth = getIntegerBetween("Largest derivation height (1 to " + integerToString(kMaxExploredDepth) + "): ",
+                                  1, kMaxExploredDepth);
+    DerivationCounts counts = countDerivations(grammar, depth);
+    BigCount total = counts.count[depth][grammar.index.get(kStartSymbol)];
+    cout << "There are " << total.toString() << " derivations of height at most " << depth << "." << endl;
+    if (total.isZero()) return;
+
+    if (getYesOrNo("Do you want to list them? ")) {
+        int listed = 0;
+        enumerateDerivations(grammar, counts, depth, [&listed](const string& sentence) {
+            if (listed == kMaxListedDerivations) return false;
+            cout << ++listed << ".) " << sentence << endl;
+            return true;
+        });
+        if (BigCount(listed) < total) cout << "... and more." << endl;
+        cout << endl;
+    }
+    int samples = getIntegerBetween("How many should be drawn uniformly (0 to "
+                                    + integerToString(kMaxSampledDerivations) + ")? ",
+                                    0, kMaxSampledDerivations);
+    for (int i = 1; i <= samples; i++) {
+        cout << i << ".) " << sampleDerivation(grammar, counts, depth) << endl << endl;
+    }
+}
+#endif
+
+
+static string getNormalizedFilename(string filename) {
+    string normalizedFileName = kGrammarsDirectory + filename;
+    if (!endsWith(normalizedFileName, kGrammarFileExtension))
+        normalizedFileName += kGrammarFileExtension;
+    return normalizedFileName;
+}
+
+// The engine shared by every draw, seeded only once
+static ranlux48& getEngine() {
+    static random_device seed;
+    static ranlux48 engine(seed());
+    return engine;
+}
+
 // Get the random situation in the place
 int getRandomInt(int min, int max) {
-    random_device seed;
-    ranlux48 engine(seed());
     uniform_int_distribution<> distrib(min, max);
-    int random = distrib(engine);
+    int random = distrib(getEngine());
 
     return random;
 }
 
+// Get a random real number in [0, 1)
+double getRandomReal() {
+    uniform_real_distribution<> distrib(0.0, 1.0);
+    return distrib(getEngine());
+}
 
-// Get the first non-terminal word which is with in brackets
-string getFirstNonterminal(const string& str) {
-    int startIndex = stringIndexOf(str, "<");
-    int endIndex = stringIndexOf(str, ">");
-    int length = endIndex - startIndex + 1;
 
-    string substr = str.substr(startIndex, length);
+int NonterminalTable::get(string_view name) const {
+    if (slots.isEmpty()) return -1;
+    return slots[findSlot(name)].value;
+}
 
-    return substr;
+bool NonterminalTable::containsKey(string_view name) const {
+    return get(name) != -1;
 }
 
-// Get the map of the nonterminal and the cooperate expansion
-Map<string, Vector<string>> getDefinition(string fileName) {
-    ifstream input;
-    input.open(fileName);
-    string line;
-    Map<string, Vector<string>> definition;
+void NonterminalTable::put(string_view name, int value) {
+    if ((count + 1) * 2 > slots.size()) {
+        grow();
+    }
+    Slot& slot = slots[findSlot(name)];
+    if (slot.value == -1) {
+        slot.name = name;
+        count++;
+    }
+    slot.value = value;
+}
 
-    while(getline(input,line)) {
+int NonterminalTable::size() const {
+    return count;
+}
+
+// Linear probing from the hashed slot, stopping at the name or at an empty slot
+int NonterminalTable::findSlot(string_view name) const {
+    int mask = slots.size() - 1;
+    int i = hash<string_view>()(name) & mask;
+    while (slots[i].value != -1 && slots[i].name != name) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void NonterminalTable::grow() {
+    Vector<Slot> oldSlots = slots;
+    slots = Vector<Slot>(max(16, oldSlots.size() * 2), Slot());
+    for (const Slot& slot : oldSlots) {
+        if (slot.value != -1) {
+            slots[findSlot(slot.name)] = slot;
+        }
+    }
+}
+
+// Trim the white space on both ends without copying
+string_view trimView(string_view text) {
+    while (!text.empty() && isspace((unsigned char) text.front())) text.remove_prefix(1);
+    while (!text.empty() && isspace((unsigned char) text.back())) text.remove_suffix(1);
+    return text;
+}
+
+// Cut the next line (without its line break) off the front of the text
+bool getNextLine(string_view& text, string_view& line) {
+    if (text.empty()) return false;
+    size_t endIndex = text.find('\n');
+    if (endIndex == string_view::npos) {
+        line = text;
+        text = {};
+    } else {
+        line = text.substr(0, endIndex);
+        text.remove_prefix(endIndex + 1);
+    }
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    return true;
+}
+
+// Strip the optional "{weight}" prefix off an expansion line and return the weight
+double parseWeight(string_view& line) {
+    if (line.empty() || line.front() != '{') return 1.0;
+
+    size_t endIndex = line.find('}');
+    if (endIndex == string_view::npos) {
+        error("Unterminated weight in expansion \"" + string(line) + "\"");
+    }
+    // strtod stops at the closing brace at the latest
+    char* numberEnd;
+    double weight = strtod(line.data() + 1, &numberEnd);
+    string_view rest = trimView(line.substr(numberEnd - line.data(), endIndex - (numberEnd - line.data())));
+    if (numberEnd == line.data() + 1 || !rest.empty() || !isfinite(weight) || weight <= 0) {
+        error("Invalid weight \"" + string(line.substr(1, endIndex - 1)) + "\", weights must be finite positive numbers");
+    }
+    line = trimView(line.substr(endIndex + 1));
+
+    return weight;
+}
+
+// Build the Walker/Vose alias table, so each draw costs O(1) whatever the size
+void buildAliasTable(Grammar& grammar, const Production& production) {
+    int n = production.count;
+    double totalWeight = 0;
+    for (int i = 0; i < n; i++) {
+        totalWeight += grammar.weights[production.first + i];
+    }
+
+    // Scale the weights so the average column holds exactly 1
+    Vector<double> scaled;
+    Stack<int> small;
+    Stack<int> large;
+    for (int i = 0; i < n; i++) {
+        scaled.add(grammar.weights[production.first + i] * n / totalWeight);
+        if (scaled[i] < 1.0) {
+            small.push(i);
+        } else {
+            large.push(i);
+        }
+    }
+
+    // Fill each small column up to 1 with the mass of a large one
+    while (!small.isEmpty() && !large.isEmpty()) {
+        int less = small.pop();
+        int more = large.pop();
+        grammar.probability[production.first + less] = scaled[less];
+        grammar.alias[production.first + less] = more;
+        scaled[more] = (scaled[more] + scaled[less]) - 1.0;
+        if (scaled[more] < 1.0) {
+            small.push(more);
+        } else {
+            large.push(more);
+        }
+    }
+
+    // Whatever is left over is full up to rounding error
+    while (!large.isEmpty()) {
+        grammar.probability[production.first + large.pop()] = 1.0;
+    }
+    while (!small.isEmpty()) {
+        grammar.probability[production.first + small.pop()] = 1.0;
+    }
+}
+
+/**
+ * Function: getDefinition
+ * -----------------------
+ * Maps the whole grammar file into memory and compiles it in place: names
+ * and expansions stay views into the mapping instead of being copied line
+ * by line into strings.
+ */
+Grammar getDefinition(string fileName) {
+    Grammar grammar;
+
+    int fd = open(fileName.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd != -1 && fstat(fd, &info) == -1) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd == -1) {
+        error("Unable to open the grammar file \"" + fileName + "\"");
+    }
+    size_t fileSize = info.st_size;
+    if (fileSize > 0) {
+        void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            error("Unable to map the grammar file \"" + fileName + "\"");
+        }
+        madvise(mapping, fileSize, MADV_SEQUENTIAL);
+        grammar.text = shared_ptr<const char>((const char*) mapping, [fileSize](const char* data) {
+            munmap((void*) data, fileSize);
+        });
+    }
+    close(fd);
+
+    string_view text(grammar.text.get(), fileSize);
+    string_view line;
+
+    while(getNextLine(text, line)) {
         // Start of the definition
-        if (startsWith(line, '<') && endsWith(line, '>')) {
+        if (!line.empty() && line.front() == '<' && line.back() == '>') {
             // The key of the definition
-            string nonterminal = line;
-            // The value of the definition
-            Vector<string> expansion;
+            string_view nonterminal = line;
 
             // Get the number of possible expansions
-            getline(input,line);
-            int lineNum = stringToInteger(line);
+            getNextLine(text, line);
+            line = trimView(line);
+            int lineNum = 0;
+            for (char digit : line) {
+                if (!isdigit((unsigned char) digit)) {
+                    error("Invalid expansion count for " + string(nonterminal));
+                }
+                lineNum = lineNum * 10 + (digit - '0');
+            }
 
             // Loop all the possible expansion
+            Production production;
+            production.first = grammar.expansions.size();
             for (int i = 0; i < lineNum; i++) {
-                getline(input,line);
-                expansion.add(line);
+                if (!getNextLine(text, line)) {
+                    error("The grammar ends in the middle of " + string(nonterminal));
+                }
+                grammar.weights.add(parseWeight(line));
+                grammar.expansions.add(line);
+                grammar.probability.add(1.0);
+                grammar.alias.add(0);
+            }
+            production.count = lineNum;
+            if (lineNum == 0) {
+                error("The nonterminal " + string(nonterminal) + " has no expansions");
             }
 
-            // Put the key and value to the map
-            definition[nonterminal] = expansion;
+            // Precompute the alias table and put the production to the grammar
+            buildAliasTable(grammar, production);
+            int i = grammar.index.get(nonterminal);
+            if (i != -1) {
+                grammar.productions[i] = production;
+            } else {
+                grammar.index.put(nonterminal, grammar.productions.size());
+                grammar.names.add(nonterminal);
+                grammar.productions.add(production);
+            }
         }
     }
 
-    input.close();
+    // Validate the grammar once, before any sentence is generated
+    analyzeGrammar(grammar);
 
-    return definition;
+    return grammar;
+}
+
+// Split every expansion into its terminal length and the nonterminals it refers to
+void resolveReferences(Grammar& grammar) {
+    grammar.terminalLength.clear();
+    grammar.referenceStart.clear();
+    grammar.references.clear();
+    for (string_view expansion : grammar.expansions) {
+        grammar.referenceStart.add(grammar.references.size());
+        int terminalLength = 0;
+        size_t position = 0;
+        while (true) {
+            size_t startIndex = expansion.find('<', position);
+            size_t endIndex = startIndex == string_view::npos ? startIndex : expansion.find('>', startIndex);
+            if (endIndex == string_view::npos) {
+                terminalLength += expansion.length() - position;
+                break;
+            }
+            terminalLength += startIndex - position;
+            grammar.references.add(grammar.index.get(expansion.substr(startIndex, endIndex - startIndex + 1)));
+            position = endIndex + 1;
+        }
+        grammar.terminalLength.add(terminalLength);
+    }
+    grammar.referenceStart.add(grammar.references.size());
 }
 
-string getRandomExpansion(const Map<string, Vector<string>>& definition, const string nonterminal) {
-    Vector<string> expansions = definition[nonterminal];
-    int maxIndex = expansions.size() - 1;
-    int randomIndex = getRandomInt(0, maxIndex);
-    string randomExpansion = expansions[randomIndex];
+/**
+ * Function: analyzeGrammar
+ * ------------------------
+ * Checks the grammar for undefined, unreachable and non-terminating
+ * nonterminals, and computes the expected length of every nonterminal by
+ * fixed-point iteration.  Problems that would make generateSentence fail or
+ * run away are reported with error, harmless ones are only printed.
+ */
+void analyzeGrammar(Grammar& grammar) {
+    resolveReferences(grammar);
+    int start = grammar.index.get(kStartSymbol);
+    if (start == -1) {
+        error("The grammar has no " + kStartSymbol + " nonterminal");
+    }
+    int n = grammar.productions.size();
+
+    // Reachability: breadth first search from the start symbol
+    Set<string> undefined;
+    Queue<int> toVisit;
+    toVisit.enqueue(start);
+    grammar.productions[start].isReachable = true;
+    while (!toVisit.isEmpty()) {
+        const Production& production = grammar.productions[toVisit.dequeue()];
+        for (int e = production.first; e < production.first + production.count; e++) {
+            string_view expansion = grammar.expansions[e];
+            size_t position = 0;
+            for (int r = grammar.referenceStart[e]; r < grammar.referenceStart[e + 1]; r++) {
+                int reference = grammar.references[r];
+                size_t startIndex = expansion.find('<', position);
+                position = expansion.find('>', startIndex) + 1;
+                if (reference == -1) {
+                    undefined.add(string(expansion.substr(startIndex, position - startIndex)));
+                } else if (!grammar.productions[reference].isReachable) {
+                    grammar.productions[reference].isReachable = true;
+                    toVisit.enqueue(reference);
+                }
+            }
+        }
+    }
+    if (!undefined.isEmpty()) {
+        string names;
+        for (string name : undefined) {
+            names += " " + name;
+        }
+        error("The grammar uses undefined nonterminals:" + names);
+    }
 
-    return randomExpansion;
+    // Termination: a nonterminal terminates once one of its expansions only uses terminating ones
+    bool isChanged = true;
+    while (isChanged) {
+        isChanged = false;
+        for (Production& production : grammar.productions) {
+            if (production.canTerminate) continue;
+            for (int e = production.first; e < production.first + production.count; e++) {
+                bool isTerminating = true;
+                for (int r = grammar.referenceStart[e]; r < grammar.referenceStart[e + 1]; r++) {
+                    int reference = grammar.references[r];
+                    if (reference == -1 || !grammar.productions[reference].canTerminate) {
+                        isTerminating = false;
+                        break;
+                    }
+                }
+                if (isTerminating) {
+                    production.canTerminate = true;
+                    isChanged = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    string unreachable;
+    for (int i = 0; i < n; i++) {
+        const Production& production = grammar.productions[i];
+        if (!production.isReachable) {
+            unreachable += " " + string(grammar.names[i]);
+        } else if (!production.canTerminate) {
+            error("The nonterminal " + string(grammar.names[i]) + " can never finish expanding");
+        }
+    }
+    if (!unreachable.empty()) {
+        cout << "Warning: these nonterminals can't be reached from " << kStartSymbol << ":" << unreachable << endl;
+    }
+
+    // Expected length: iterate E(A) = sum of p(e) * (terminals of e + sum of E(B) for each B in e)
+    Vector<double> expectedLength(n, 0.0);
+    bool isConverged = false;
+    for (int iteration = 0; iteration < kMaxLengthIterations && !isConverged; iteration++) {
+        isConverged = true;
+        for (int i = 0; i < n; i++) {
+            const Production& production = grammar.productions[i];
+            if (!production.isReachable) continue;
+            double totalWeight = 0;
+            double length = 0;
+            for (int e = production.first; e < production.first + production.count; e++) {
+                double expansionLength = grammar.terminalLength[e];
+                for (int r = grammar.referenceStart[e]; r < grammar.referenceStart[e + 1]; r++) {
+                    expansionLength += expectedLength[grammar.references[r]];
+                }
+                totalWeight += grammar.weights[e];
+                length += grammar.weights[e] * expansionLength;
+            }
+            length /= totalWeight;
+            if (length > kMaxExpectedLength) {
+                error("The expected length of " + string(grammar.names[i]) + " diverges");
+            }
+            if (length - expectedLength[i] > kLengthTolerance * max(1.0, length)) {
+                isConverged = false;
+            }
+            expectedLength[i] = length;
+        }
+    }
+    if (!isConverged) {
+        error("The expected length of the grammar doesn't converge, it is too recursive");
+    }
+    for (int i = 0; i < n; i++) {
+        grammar.productions[i].expectedLength = expectedLength[i];
+    }
+}
+
+// Pick a column uniformly, then keep it or take its alias; returns the expansion number
+int getRandomColumn(const Grammar& grammar, const Production& production) {
+    int column = getRandomInt(0, production.count - 1);
+    if (getRandomReal() >= grammar.probability[production.first + column]) {
+        column = grammar.alias[production.first + column];
+    }
+
+    return production.first + column;
+}
+
+string_view getRandomExpansion(const Grammar& grammar, string_view nonterminal) {
+    const Production& production = grammar.productions[grammar.index.get(nonterminal)];
+
+    return grammar.expansions[getRandomColumn(grammar, production)];
+}
+
+/**
+ * Type: Cursor
+ * ------------
+ * How far the generator got through one chosen expansion: the character
+ * position and the next of its references to expand.
+ */
+struct Cursor {
+    int expansion;
+    int position;
+    int reference;
+    int depth = 0;      // height left for the references, used by the counted modes
+};
+
+string generateSentence(const Grammar& grammar) {
+    // Size the sentence from the analysis, so it rarely has to grow
+    const Production& start = grammar.productions[grammar.index.get(kStartSymbol)];
+    string sentence;
+    sentence.reserve(start.expectedLength * 2);
+
+    // Expand the leftmost nonterminal first, each occurrence on its own
+    Stack<Cursor> pending;
+    int first = getRandomColumn(grammar, start);
+    pending.push({first, 0, grammar.referenceStart[first]});
+    while (!pending.isEmpty()) {
+        Cursor cursor = pending.pop();
+        string_view expansion = grammar.expansions[cursor.expansion];
+
+        // No nonterminal left, copy the rest of the expansion
+        if (cursor.reference == grammar.referenceStart[cursor.expansion + 1]) {
+            sentence.append(expansion.substr(cursor.position));
+            continue;
+        }
+
+        // Copy the terminals up to the next nonterminal, then expand it
+        size_t startIndex = expansion.find('<', cursor.position);
+        size_t endIndex = expansion.find('>', startIndex);
+        sentence.append(expansion.substr(cursor.position, startIndex - cursor.position));
+        pending.push({cursor.expansion, (int) endIndex + 1, cursor.reference + 1});
+
+        int next = getRandomColumn(grammar, grammar.productions[grammar.references[cursor.reference]]);
+        pending.push({next, 0, grammar.referenceStart[next]});
+    }
+
+    return sentence;
 }
 
 string generateSentence(string fileName) {
@@ -140,17 +705,309 @@ string generateSentence(string fileName) {
     string filePath = getNormalizedFilename(fileName);
 
     // Get all the definition
-    Map<string, Vector<string>> definition = getDefinition(filePath);
+    Grammar grammar = getDefinition(filePath);
+
+    return generateSentence(grammar);
+}
+
+
+/* * * * Counting, enumerating and sampling derivations * * * */
+
+BigCount::BigCount(uint64_t value) {
+    while (value > 0) {
+        limbs.add((uint32_t) value);
+        value >>= 32;
+    }
+}
+
+bool BigCount::isZero() const {
+    return limbs.isEmpty();
+}
+
+// Drop the leading zero limbs, so zero has no limbs at all
+void BigCount::trim() {
+    while (!limbs.isEmpty() && limbs[limbs.size() - 1] == 0) {
+        limbs.remove(limbs.size() - 1);
+    }
+}
+
+BigCount BigCount::operator+(const BigCount& other) const {
+    BigCount sum;
+    uint64_t carry = 0;
+    for (int i = 0; i < max(limbs.size(), other.limbs.size()) || carry > 0; i++) {
+        if (i < limbs.size()) carry += limbs[i];
+        if (i < other.limbs.size()) carry += other.limbs[i];
+        sum.limbs.add((uint32_t) carry);
+        carry >>= 32;
+    }
+    return sum;
+}
+
+BigCount BigCount::operator-(const BigCount& other) const {
+    BigCount difference = *this;
+    int64_t borrow = 0;
+    for (int i = 0; i < difference.limbs.size(); i++) {
+        int64_t limb = (int64_t) difference.limbs[i] - borrow - (i < other.limbs.size() ? other.limbs[i] : 0);
+        borrow = limb < 0 ? 1 : 0;
+        difference.limbs[i] = (uint32_t) (limb + (borrow << 32));
+    }
+    difference.trim();
+    return difference;
+}
+
+BigCount BigCount::operator*(const BigCount& other) const {
+    BigCount product;
+    if (isZero() || other.isZero()) return product;
+    product.limbs = Vector<uint32_t>(limbs.size() + other.limbs.size(), 0);
+    for (int i = 0; i < limbs.size(); i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < other.limbs.size() || carry > 0; j++) {
+            uint64_t current = product.limbs[i + j] + carry;
+            if (j < other.limbs.size()) current += (uint64_t) limbs[i] * other.limbs[j];
+            product.limbs[i + j] = (uint32_t) current;
+            carry = current >> 32;
+        }
+    }
+    product.trim();
+    return product;
+}
+
+bool BigCount::operator<(const BigCount& other) const {
+    if (limbs.size() != other.limbs.size()) return limbs.size() < other.limbs.size();
+    for (int i = limbs.size() - 1; i >= 0; i--) {
+        if (limbs[i] != other.limbs[i]) return limbs[i] < other.limbs[i];
+    }
+    return false;
+}
+
+// Print in decimal by dividing by 10^9 repeatedly
+string BigCount::toString() const {
+    if (isZero()) return "0";
+    Vector<uint32_t> rest = limbs;
+    Vector<uint32_t> chunks;
+    while (!rest.isEmpty()) {
+        uint64_t remainder = 0;
+        for (int i = rest.size() - 1; i >= 0; i--) {
+            uint64_t current = (remainder << 32) | rest[i];
+            rest[i] = (uint32_t) (current / 1000000000);
+            remainder = current % 1000000000;
+        }
+        chunks.add((uint32_t) remainder);
+        while (!rest.isEmpty() && rest[rest.size() - 1] == 0) {
+            rest.remove(rest.size() - 1);
+        }
+    }
+    string text = to_string(chunks[chunks.size() - 1]);
+    for (int i = chunks.size() - 2; i >= 0; i--) {
+        string chunk = to_string(chunks[i]);
+        text += string(9 - chunk.length(), '0') + chunk;
+    }
+    return text;
+}
+
+// Draw uniformly from [0, bound) by rejection on the bound's bit length
+BigCount BigCount::randomBelow(const BigCount& bound) {
+    int top = bound.limbs.size() - 1;
+    uint32_t topMask = bound.limbs[top];
+    topMask |= topMask >> 1;
+    topMask |= topMask >> 2;
+    topMask |= topMask >> 4;
+    topMask |= topMask >> 8;
+    topMask |= topMask >> 16;
+
+    uniform_int_distribution<uint32_t> distrib;
+    while (true) {
+        BigCount value;
+        for (int i = 0; i <= top; i++) {
+            value.limbs.add(distrib(getEngine()));
+        }
+        value.limbs[top] &= topMask;
+        value.trim();
+        if (value < bound) return value;
+    }
+}
+
+// How many derivations of height at most depth + 1 start with this expansion
+BigCount countExpansion(const Grammar& grammar, const DerivationCounts& counts, int expansion, int depth) {
+    BigCount product = 1;
+    for (int r = grammar.referenceStart[expansion]; r < grammar.referenceStart[expansion + 1]; r++) {
+        product = product * counts.count[depth][grammar.references[r]];
+        if (product.isZero()) break;
+    }
+    return product;
+}
+
+/**
+ * Function: countDerivations
+ * --------------------------
+ * Counts the derivation trees of every nonterminal for every height up to
+ * maxDepth.  An ambiguous grammar can derive the same sentence twice, so
+ * the counts are an upper bound on the number of distinct sentences.
+ */
+DerivationCounts countDerivations(const Grammar& grammar, int maxDepth) {
+    int n = grammar.productions.size();
+    DerivationCounts counts;
+    counts.count.add(Vector<BigCount>(n, BigCount()));
+
+    for (int depth = 1; depth <= maxDepth; depth++) {
+        Vector<BigCount> level(n, BigCount());
+        for (int i = 0; i < n; i++) {
+            const Production& production = grammar.productions[i];
+            for (int e = production.first; e < production.first + production.count; e++) {
+                level[i] = level[i] + countExpansion(grammar, counts, e, depth - 1);
+            }
+        }
+        counts.count.add(level);
+    }
+
+    return counts;
+}
+
+/**
+ * Type: PendingNode
+ * -----------------
+ * One cursor of the pending list, linked to the cursor below it.  The
+ * nodes are never changed once added, so a choice point keeps the list as
+ * it was by keeping its head, and the lists of later choices share it.
+ */
+struct PendingNode {
+    Cursor cursor;
+    int next;           // -1 at the bottom
+};
+
+/**
+ * Type: Alternatives
+ * ------------------
+ * A nonterminal whose expansions are still being tried: the pending list,
+ * node count and sentence length to go back to, and the next expansion.
+ */
+struct Alternatives {
+    int pending;
+    int nodeCount;
+    int length;
+    int production;
+    int next;
+    int depth;          // height left for the nonterminal
+};
+
+// Push a choice point for the nonterminal, starting with its first expansion
+static void addAlternatives(const Grammar& grammar, Vector<Alternatives>& alternatives, int pending,
+                            int nodeCount, int length, int production, int depth) {
+    alternatives.add({pending, nodeCount, length, production, grammar.productions[production].first, depth});
+}
+
+/**
+ * Function: enumerateDerivations
+ * ------------------------------
+ * Streams every derivation of <start> of height at most depth to visit,
+ * in a fixed order: expansions in file order, leftmost nonterminal first.
+ * Nothing but the current derivation and its choice points is kept, and
+ * branches that can't finish are never entered; visit returns false to
+ * stop early.
+ */
+void enumerateDerivations(const Grammar& grammar, const DerivationCounts& counts, int depth,
+                          const function<bool(const string&)>& visit) {
+    if (depth < 1 || depth >= counts.count.size()) {
+        error("The derivations aren't counted to depth " + integerToString(depth));
+    }
+
+    Vector<PendingNode> nodes;
+    Vector<Alternatives> alternatives;
+    string sentence;
+    addAlternatives(grammar, alternatives, -1, 0, 0, grammar.index.get(kStartSymbol), depth);
+    while (!alternatives.isEmpty()) {
+        // Take the next expansion that can finish within the depth left, or backtrack
+        Alternatives& choice = alternatives[alternatives.size() - 1];
+        const Production& production = grammar.productions[choice.production];
+        int e = choice.next;
+        while (e < production.first + production.count
+               && countExpansion(grammar, counts, e, choice.depth - 1).isZero()) {
+            e++;
+        }
+        if (e == production.first + production.count) {
+            alternatives.remove(alternatives.size() - 1);
+            continue;
+        }
+        choice.next = e + 1;
+
+        // Go back to the choice point and expand leftmost first up to the next one
+        while (nodes.size() > choice.nodeCount) {
+            nodes.remove(nodes.size() - 1);
+        }
+        sentence.resize(choice.length);
+        nodes.add({{e, 0, grammar.referenceStart[e], choice.depth - 1}, choice.pending});
+        int pending = nodes.size() - 1;
+        bool isFinished = true;
+        while (pending != -1) {
+            Cursor cursor = nodes[pending].cursor;
+            pending = nodes[pending].next;
+            string_view expansion = grammar.expansions[cursor.expansion];
+
+            if (cursor.reference == grammar.referenceStart[cursor.expansion + 1]) {
+                // No nonterminal left, copy the rest of the expansion
+                sentence.append(expansion.substr(cursor.position));
+                continue;
+            }
+
+            // Copy the terminals up to the next nonterminal, which becomes the next choice point
+            size_t startIndex = expansion.find('<', cursor.position);
+            size_t endIndex = expansion.find('>', startIndex);
+            sentence.append(expansion.substr(cursor.position, startIndex - cursor.position));
+            nodes.add({{cursor.expansion, (int) endIndex + 1, cursor.reference + 1, cursor.depth}, pending});
+            addAlternatives(grammar, alternatives, nodes.size() - 1, nodes.size(), sentence.length(),
+                            grammar.references[cursor.reference], cursor.depth);
+            isFinished = false;
+            break;
+        }
+        if (isFinished && !visit(sentence)) return;
+    }
+}
+
+// Choose an expansion with probability proportional to its number of derivations
+static int chooseCountedExpansion(const Grammar& grammar, const DerivationCounts& counts,
+                                  int production, int depth) {
+    const Production& p = grammar.productions[production];
+    BigCount rest = BigCount::randomBelow(counts.count[depth][production]);
+    for (int e = p.first; e < p.first + p.count; e++) {
+        BigCount count = countExpansion(grammar, counts, e, depth - 1);
+        if (rest < count) return e;
+        rest = rest - count;
+    }
+    return p.first + p.count - 1;
+}
+
+/**
+ * Function: sampleDerivation
+ * --------------------------
+ * Picks one derivation of <start> of height at most depth uniformly at
+ * random, unlike generateSentence which follows the production weights.
+ */
+string sampleDerivation(const Grammar& grammar, const DerivationCounts& counts, int depth) {
+    int start = grammar.index.get(kStartSymbol);
+    if (depth < 1 || depth >= counts.count.size() || counts.count[depth][start].isZero()) {
+        error("The grammar has no derivation of depth " + integerToString(depth));
+    }
+
+    string sentence;
+    Stack<Cursor> pending;
+    int first = chooseCountedExpansion(grammar, counts, start, depth);
+    pending.push({first, 0, grammar.referenceStart[first], depth - 1});
+    while (!pending.isEmpty()) {
+        Cursor cursor = pending.pop();
+        string_view expansion = grammar.expansions[cursor.expansion];
+
+        if (cursor.reference == grammar.referenceStart[cursor.expansion + 1]) {
+            sentence.append(expansion.substr(cursor.position));
+            continue;
+        }
 
-    // Get the start expansion
-    string sentence = getRandomExpansion(definition, "<start>");
+        size_t startIndex = expansion.find('<', cursor.position);
+        size_t endIndex = expansion.find('>', startIndex);
+        sentence.append(expansion.substr(cursor.position, startIndex - cursor.position));
+        pending.push({cursor.expansion, (int) endIndex + 1, cursor.reference + 1, cursor.depth});
 
-    // Generate the random sentence
-    while(stringIndexOf(sentence, "<") != -1) {
-        string nonterminal = getFirstNonterminal(sentence);
-        string expansion = getRandomExpansion(definition, nonterminal);
-        string temp = stringReplace(sentence, nonterminal, expansion);
-        sentence = temp;
+        int next = chooseCountedExpansion(grammar, counts, grammar.references[cursor.reference], cursor.depth);
+        pending.push({next, 0, grammar.referenceStart[next], cursor.depth - 1});
     }
 
     return sentence;
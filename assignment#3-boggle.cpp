@@ -9,6 +9,16 @@
 #include <iostream>
 #include <random>
 #include <iterator>
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <climits>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <ctype.h>
 #include "console.h"
 #include "gboggle.h"
@@ -19,8 +29,11 @@
 #include "grid.h"
 #include "map.h"
 #include "set.h"
-#include "lexicon.h"
+#include "error.h"
+#include "dictionary-image.h"
+#include "search-stats.h"
 #include <typeinfo>
+#include <vector>
 using namespace std;
 
 static const string kStandardCubes[16] = {
@@ -42,22 +55,167 @@ static const int kMinLength = 4;
 static const double kDelayBetweenHighlights = 100;
 static const double kDelayAfterAllHighlights = 500;
 static const string wordsPath = "res/dictionary.txt";
+static const string kImagePath = "res/dictionary.dawg";
+static const string kCubesDirectory = "res/cubes/";
 
+// The GADDAG separator sorts right after 'Z', so it is child bit 26 of a DAWG node
+static const char kGaddagSeparator = 'Z' + 1;
+
+// The simulated annealing schedule of the board optimiser
+static const double kInitialTemperature = 8.0;
+static const double kFinalTemperature = 0.2;
+
+// On smaller boards most paths go through any given cell, so re-solving is cheaper
+static const int kMinIncrementalDimension = 5;
+
+// Cell indexes must fit in a byte, which bounds the board size
+static const int kMinDimension = 4;
+static const int kMaxDimension = 16;
+static const int kMaxCells = kMaxDimension * kMaxDimension;
+
+/**
+ * Type: NeighbourTable
+ * --------------------
+ * The adjoining cells of every cell of a dimension x dimension board,
+ * computed once per dimension and shared by every board of that size.
+ */
+struct NeighbourTable {
+    int dimension = 0;
+    uint8_t count[kMaxCells] = {};
+    uint8_t cells[kMaxCells][8] = {};
+};
+
+/**
+ * Type: WideMask
+ * --------------
+ * The visited set of boards with more than 64 cells.  Smaller boards use
+ * a plain 32 or 64-bit integer instead.
+ */
+struct WideMask {
+    uint64_t words[kMaxCells / 64] = {};
+};
+
+/**
+ * Type: FoundWord
+ * ---------------
+ * A word found on the board: its id in the dictionary's sorted word table,
+ * and where its path of cell indexes (row * dimension + column) starts in
+ * BoggleSolver::paths.
+ */
+struct FoundWord {
+    int id;
+    int pathStart;
+    int length;
+};
+
+/**
+ * Type: BoggleSolver
+ * ------------------
+ * The reusable state of the search.  The result buffers are std::vectors
+ * because clear() keeps their capacity, so once they have grown to the
+ * size of a busy board, solving another board does no heap allocation.
+ */
+struct BoggleSolver {
+    vector<int> foundStamp;         // per word id, equal to stamp if found on this board
+    int stamp = 0;
+    vector<FoundWord> found;
+    vector<uint8_t> paths;
+
+    const NeighbourTable* neighbours = nullptr;
+    char letters[kMaxCells];
+    uint8_t path[kMaxCells];        // the cells of the current path
+};
+
+/**
+ * Type: ValidWords
+ * ----------------
+ * All the words of one board in flat storage.  A word is identified by
+ * its id, its path is packed as cell-index bytes in one arena, and a small
+ * open-addressing table finds a word by its id in O(1).
+ */
+struct ValidWords {
+    int dimension = 0;
+    string letters;
+    vector<FoundWord> words;
+    vector<uint8_t> paths;
+    vector<int> slots;              // index into words + 1 by hashed id, 0 if empty
+};
+
+/**
+ * Type: PathChange
+ * ----------------
+ * One path gained (+1) or lost (-1) by the word with the id.
+ */
+struct PathChange {
+    int id;
+    int length;
+    int sign;
+};
+
+/**
+ * Type: BoardOptimiser
+ * --------------------
+ * The state of one simulated annealing search.  It keeps the number of
+ * paths that spell every word on the current board, so changing a cell
+ * only re-walks the paths through that cell: the GADDAG finds them by
+ * reading backwards from the cell to the start of the word, then forwards.
+ * Boards smaller than kMinIncrementalDimension are simply re-solved.
+ */
+struct BoardOptimiser {
+    int dimension = 0;
+    int cellCount = 0;
+    const NeighbourTable* neighbours = nullptr;
+    char letters[kMaxCells];
+    int score = 0;
+
+    bool isIncremental = true;
+    int previousScore = 0;          // to undo a re-solved change
+    string board;                   // the letters, for re-solving
+    BoggleSolver solver;
+
+    vector<int> pathCounts;         // per word id
+    vector<PathChange> changes;     // made by the last move, to undo it
+    int sign = 1;                   // of the changes being recorded
+    uint8_t reversePath[kMaxCells]; // from the changed cell back to the start of the word
+    uint8_t forwardPath[kMaxCells]; // after the changed cell
+    mt19937 engine;
+};
+
+#ifndef BENCHMARK
 static void welcome();
 static void giveInstructions();
 static int getPreferredBoardSize();
-static void playBoggle();
+static void playBoggle(const Dictionary& dictionary);
+static void runBatchMode(const Dictionary& dictionary);
+static void runOptimiserMode(const Dictionary& dictionary);
+#endif
 string getInputTopChars(int dimension);
 string getRandomTopChars(int dimension);
 void drawAllChars(string topChars, int dimension);
 Grid<char> getCubes(const string& topChars, int dimension);
-Map<string, Vector<Vector<int>>> getValidWords(const Lexicon& words, const int dimension, const string& topchars);
-void findNextChar(
-    const Grid<char>& cubes, Grid<int>& currentPosition, const Lexicon& words, const int dimension,
-    Map<string, Vector<Vector<int>>>& validWords, Vector<Vector<int>>& currentPrefixIndex
-);
-void playGame(const Map<string, Vector<Vector<int>>>& validWords, Lexicon words);
+Dictionary buildGaddag(const Dictionary& dictionary);
+const NeighbourTable& getNeighbourTable(int dimension);
+void solveBoard(const Dictionary& dictionary, const string& topChars, int dimension, BoggleSolver& solver);
+string getFoundWord(const BoggleSolver& solver, const FoundWord& word);
+ValidWords getValidWords(const Dictionary& dictionary, const int dimension, const string& topchars);
+int findValidWord(const Dictionary& dictionary, const ValidWords& validWords, const string& word);
+string getValidWord(const ValidWords& validWords, int index);
+template <int Dimension, typename Mask>
+void findNextChar(const Dictionary& dictionary, BoggleSolver& solver, int cell, int node, int rank,
+                  Mask visited, int depth);
+Vector<string> loadCubes(int dimension);
+void playGame(const Dictionary& dictionary, const ValidWords& validWords);
+Vector<string> readBoards(const string& path);
+int getBoardDimension(const string& topChars);
+string scoreBoard(const Dictionary& dictionary, const string& topChars, BoggleSolver& solver);
+double solveBatch(const Dictionary& dictionary, const Vector<string>& boards, int threadCount, ostream* out);
+int getBoardScore(const Dictionary& dictionary, const string& topChars);
+void resetOptimiser(const Dictionary& dictionary, BoardOptimiser& optimiser);
+void changeCell(const Dictionary& dictionary, const Dictionary& gaddag, BoardOptimiser& optimiser,
+                int cell, char letter);
+void undoChange(BoardOptimiser& optimiser, int cell, char letter);
 
+#ifndef BENCHMARK
 /**
  * Function: main
  * --------------
@@ -67,9 +225,15 @@ int main() {
     GWindow gw(kBoggleWindowWidth, kBoggleWindowHeight);
     initGBoggle(gw);
     welcome();
+
+    // Map the dictionary image once, every game and the batch mode share it
+    Dictionary dictionary = loadDictionary(kImagePath, wordsPath);
+    if (getYesOrNo("Do you want to score a file of boards in batch mode?")) runBatchMode(dictionary);
+    if (getYesOrNo("Do you want to search for high-scoring boards?")) runOptimiserMode(dictionary);
+
     if (getYesOrNo("Do you need instructions?")) giveInstructions();
     do {
-        playBoggle();
+        playBoggle(dictionary);
     } while (getYesOrNo("Would you like to play again?"));
     cout << "Thank you for playing!" << endl;
     shutdownGBoggle();
@@ -126,12 +290,14 @@ static void giveInstructions() {
  * Function: getPreferredBoardSize
  * -------------------------------
  * Repeatedly prompts the user until he or she responds with one
- * of the two supported Boggle board dimensions.
+ * of the supported Boggle board dimensions.
  */
 
 static int getPreferredBoardSize() {
-    cout << "You can choose standard Boggle (4x4 grid) or Big Boggle (5x5 grid)." << endl;
-    return getIntegerBetween("Which dimension would you prefer: 4 or 5?", 4, 5);
+    cout << "You can choose standard Boggle (4x4 grid), Big Boggle (5x5 grid), or any larger board up to "
+         << kMaxDimension << "x" << kMaxDimension << "." << endl;
+    return getIntegerBetween("Which dimension would you prefer: 4 to " + integerToString(kMaxDimension) + "?",
+                             kMinDimension, kMaxDimension);
 }
 
 /**
@@ -140,7 +306,7 @@ static int getPreferredBoardSize() {
  * Manages all details needed for the user to play one
  * or more games of Boggle.
  */
-static void playBoggle() {
+static void playBoggle(const Dictionary& dictionary) {
     int dimension = getPreferredBoardSize();
     drawBoard(dimension, dimension);
     cout << "This is where you'd play the game of Boggle." << endl;
@@ -151,10 +317,135 @@ static void playBoggle() {
         topChars = getRandomTopChars(dimension);
     }
     drawAllChars(topChars, dimension);
-    Lexicon words(wordsPath);
-    Map<string, Vector<Vector<int>>> validWords = getValidWords(words, dimension, topChars);
-    playGame(validWords, words);
+    ValidWords validWords = getValidWords(dictionary, dimension, topChars);
+    playGame(dictionary, validWords);
+}
+
+/**
+ * Function: runBatchMode
+ * --------------------
+ * Prompt for a file of boards, one topChars string per line, and stream
+ * every board's score and words to a file or the console, solving them
+ * on all the cores.  Optionally measure how the throughput scales with
+ * the number of threads.
+ */
+static void runBatchMode(const Dictionary& dictionary) {
+    string boardsPath = trim(getLine("Boards file: "));
+    Vector<string> boards = readBoards(boardsPath);
+    if (boards.isEmpty()) {
+        cout << "No boards found in \"" << boardsPath << "\"." << endl;
+        return;
+    }
+
+    string outputPath = trim(getLine("Output file [return for the console]: "));
+    ofstream output;
+    if (!outputPath.empty()) output.open(outputPath);
+    ostream& out = outputPath.empty() ? cout : output;
+
+    int threadCount = max(1, (int) thread::hardware_concurrency());
+    double seconds = solveBatch(dictionary, boards, threadCount, &out);
+    cout << boards.size() << " boards on " << threadCount << " threads: "
+         << (int) (boards.size() / seconds) << " boards/sec" << endl;
+
+    if (getYesOrNo("Do you want to run the scaling benchmark?")) {
+        double singleRate = 0;
+        for (int threads = 1; ; threads = min(threads * 2, threadCount)) {
+            double rate = boards.size() / solveBatch(dictionary, boards, threads, nullptr);
+            if (threads == 1) singleRate = rate;
+            cout << threads << " threads: " << (int) rate << " boards/sec, speedup "
+                 << rate / singleRate << endl;
+            if (threads == threadCount) break;
+        }
+    }
+}
+
+/**
+ * Function: runOptimiserMode
+ * --------------------
+ * Search for high-scoring boards with simulated annealing, one independent
+ * search per core, each changing one cell at a time with letters drawn by
+ * their frequency in the dictionary.  Reports the best boards found and
+ * the number of boards evaluated per second.
+ */
+static void runOptimiserMode(const Dictionary& dictionary) {
+    int dimension = getIntegerBetween("Board dimension (4 to " + integerToString(kMaxDimension) + "): ",
+                                      kMinDimension, kMaxDimension);
+    int steps = getInteger("Boards to evaluate per thread: ");
+    int threadCount = max(1, (int) thread::hardware_concurrency());
+    SEARCH_STATS_BEGIN();
+    SEARCH_STATS_CALLER(callerStats);
+    cout << "Building the GADDAG..." << endl;
+    Dictionary gaddag = buildGaddag(dictionary);
+
+    // Draw new letters in proportion to how often they appear in words
+    vector<double> letterWeights(26, 0.0);
+    int charCount = dictionary.wordStarts[dictionary.wordCount];
+    for (int i = 0; i < charCount; i++) {
+        letterWeights[dictionary.wordChars[i] - 'A'] += 1;
+    }
+
+    vector<string> bestBoards(threadCount);
+    vector<int> bestScores(threadCount, 0);
+    auto startTime = chrono::steady_clock::now();
+    auto search = [&](int threadIndex) {
+        SEARCH_STATS_WORKER_BEGIN();
+        BoardOptimiser optimiser;
+        optimiser.engine.seed(random_device()() + threadIndex);
+        discrete_distribution<int> letterDistrib(letterWeights.begin(), letterWeights.end());
+        uniform_int_distribution<int> cellDistrib(0, dimension * dimension - 1);
+        uniform_real_distribution<double> chance(0.0, 1.0);
+
+        optimiser.dimension = dimension;
+        for (int i = 0; i < dimension * dimension; i++) {
+            optimiser.letters[i] = 'A' + letterDistrib(optimiser.engine);
+        }
+        resetOptimiser(dictionary, optimiser);
+        int bestScore = optimiser.score;
+        string bestBoard(optimiser.letters, dimension * dimension);
+
+        for (int step = 0; step < steps; step++) {
+            double temperature = kInitialTemperature * pow(kFinalTemperature / kInitialTemperature, (double) step / steps);
+            int cell = cellDistrib(optimiser.engine);
+            char oldLetter = optimiser.letters[cell];
+            char newLetter = 'A' + letterDistrib(optimiser.engine);
+            if (newLetter == oldLetter) continue;
+
+            int oldScore = optimiser.score;
+            changeCell(dictionary, gaddag, optimiser, cell, newLetter);
+            int delta = optimiser.score - oldScore;
+            if (delta < 0 && chance(optimiser.engine) >= exp(delta / temperature)) {
+                undoChange(optimiser, cell, oldLetter);
+            } else if (optimiser.score > bestScore) {
+                bestScore = optimiser.score;
+                bestBoard.assign(optimiser.letters, dimension * dimension);
+            }
+        }
+        bestBoards[threadIndex] = bestBoard;
+        bestScores[threadIndex] = bestScore;
+        SEARCH_STATS_WORKER_END(callerStats);
+    };
+
+    vector<thread> workers;
+    for (int i = 0; i < threadCount; i++) {
+        workers.emplace_back(search, i);
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+
+    // Report the best board of every search, best first, checked by a full solve
+    vector<int> order;
+    for (int i = 0; i < threadCount; i++) order.push_back(i);
+    sort(order.begin(), order.end(), [&](int a, int b) { return bestScores[a] > bestScores[b]; });
+    for (int i : order) {
+        cout << bestBoards[i] << "\t" << getBoardScore(dictionary, bestBoards[i]) << endl;
+    }
+    cout << (long long) steps * threadCount << " boards evaluated on " << threadCount << " threads: "
+         << (long long) (steps * (double) threadCount / seconds) << " evaluations/sec" << endl;
+    SEARCH_STATS_END("runOptimiserMode");
 }
+#endif
 
 /**
  * Function: getInputTopChars
@@ -168,12 +459,12 @@ string getInputTopChars(int dimension) {
     cout << "the next " << dimension << " characters form the second row, and so forth." << endl;
     while (true) {
         string chars = getLine("Enter a string: ");
-        if (chars.length() != cubeNum) {
+        if ((int) chars.length() != cubeNum) {
             cout << "Enter a string that's precisely " << cubeNum << " characters long." << endl;
             continue;
         }
         bool isValid = true;
-        for (int i = 0; i < dimension; i++) {
+        for (int i = 0; i < cubeNum; i++) {
             char c = chars[i];
             if (!(c >= 'a' && c <= 'z') && !(c >= 'A' && c <= 'Z')) {
                 isValid = false;
@@ -192,11 +483,7 @@ string getInputTopChars(int dimension) {
  * the upside character.
  */
 string getRandomTopChars(int dimension) {
-    Vector<string> cubes;
-    int cubeNum = dimension * dimension;
-    for (int i = 0; i < cubeNum; i++) {
-        cubes.add(kStandardCubes[i]);
-    }
+    Vector<string> cubes = loadCubes(dimension);
 
     Vector<string> randomCubes;
     while (!cubes.isEmpty()) {
@@ -207,13 +494,53 @@ string getRandomTopChars(int dimension) {
 
     string topChars = "";
     for (string cube : randomCubes) {
-        int i = randomInteger(0, 5);
+        int i = randomInteger(0, cube.length() - 1);
         topChars += cube[i];
     }
 
     return topChars;
 }
 
+/**
+ * Function: loadCubes
+ * --------------------
+ * Return the dimension * dimension cubes of a board.  They are read from
+ * res/cubes/<dimension>x<dimension>.txt, one cube's faces per line, when
+ * that file exists.  Otherwise 4x4 and 5x5 use the standard and Big
+ * Boggle sets, and larger boards cycle through the Big Boggle set.
+ */
+Vector<string> loadCubes(int dimension) {
+    int cubeNum = dimension * dimension;
+    Vector<string> cubes;
+
+    string path = kCubesDirectory + integerToString(dimension) + "x" + integerToString(dimension) + ".txt";
+    ifstream input(path);
+    string line;
+    while (getline(input, line)) {
+        line = toUpperCase(trim(line));
+        if (line.empty() || startsWith(line, "#")) continue;
+        for (char c : line) {
+            if (c < 'A' || c > 'Z') {
+                error("The cube \"" + line + "\" in " + path + " has a face that isn't a letter");
+            }
+        }
+        cubes.add(line);
+    }
+    if (!cubes.isEmpty()) {
+        if (cubes.size() != cubeNum) {
+            error(path + " has " + integerToString(cubes.size()) + " cubes, a "
+                  + integerToString(dimension) + "x" + integerToString(dimension) + " board needs "
+                  + integerToString(cubeNum));
+        }
+        return cubes;
+    }
+
+    for (int i = 0; i < cubeNum; i++) {
+        cubes.add(dimension == 4 ? kStandardCubes[i] : kBigBoggleCubes[i % 25]);
+    }
+    return cubes;
+}
+
 /**
  * Function: getCubes
  * --------------------
@@ -231,52 +558,204 @@ Grid<char> getCubes(const string& topChars, int dimension) {
 }
 
 /**
- * Function: findNextChar
+ * Function: buildGaddag
  * --------------------
- * Receive the start char and position, save all the possible char in the cube.
+ * Compile the dictionary's words long enough to score into a GADDAG: for
+ * every split point, the letters before it reversed, the separator, then
+ * the rest.  Only its DAWG is needed, not its word table.
  */
-void findNextChar(
-    const Grid<char>& cubes, Grid<int>& currentPosition, const Lexicon& words, const int dimension,
-    Map<string, Vector<Vector<int>>>& validWords, Vector<Vector<int>>& currentPrefixIndex) {
-    // Find the current char and position
-    string currentPrefix = "";
-    int currentLen = currentPrefixIndex.size();
-    for (Vector<int> index : currentPrefixIndex) {
-        currentPrefix += cubes[index[0]][index[1]];
+Dictionary buildGaddag(const Dictionary& dictionary) {
+    Vector<string> rotations;
+    for (int id = 0; id < dictionary.wordCount; id++) {
+        string word = getDictionaryWord(dictionary, id);
+        if ((int) word.length() < kMinLength) continue;
+        for (int i = 1; i <= (int) word.length(); i++) {
+            string reversed(word.rbegin() + (word.length() - i), word.rend());
+            rotations.add(reversed + kGaddagSeparator + word.substr(i));
+        }
     }
-    int currentRow = currentPrefixIndex[currentLen - 1][0];
-    int currentCol = currentPrefixIndex[currentLen - 1][1];
-
-    // Find the loop range
-    int minRow = max(0, currentRow - 1);
-    int maxRow = min(dimension - 1, currentRow + 1);
-    int minCol = max(0, currentCol - 1);
-    int maxCol = min(dimension - 1, currentCol + 1);
+    return buildDictionary(rotations, false);
+}
 
-    // Loop all the around character
-    for (int r = minRow; r <= maxRow; r++) {
-        for (int c = minCol; c <= maxCol; c++) {
-            // Check if the character has been used
-            if (currentPosition[r][c] > 0) {
-                continue;
-            }
-            // the character has not been used
-            char nextChar = cubes[r][c];
-            string nextPrefix = currentPrefix + nextChar;
-            // Check if the prefix is in the lexicon
-            if (words.containsPrefix(nextPrefix)) {
-                Grid<int> nextPosition = currentPosition;
-                nextPosition[r][c] = currentLen + 1;
-                Vector<Vector<int>> nextPrefixIndex = currentPrefixIndex;
-                nextPrefixIndex.add({r, c});
-                // Check if this is a new valid word
-                if (nextPrefix.length() >= 4 && words.contains(nextPrefix) && !validWords.containsKey(nextPrefix)) {
-                    validWords[nextPrefix] = nextPrefixIndex;
+/**
+ * Function: buildNeighbourTable
+ * --------------------
+ * List the adjoining cells of every cell of the board, in row-major order.
+ * It can run at compile time, for the kernels specialised by dimension.
+ */
+static constexpr NeighbourTable buildNeighbourTable(int dimension) {
+    NeighbourTable table;
+    table.dimension = dimension;
+    for (int r = 0; r < dimension; r++) {
+        for (int c = 0; c < dimension; c++) {
+            int cell = r * dimension + c;
+            table.count[cell] = 0;
+            for (int dr = -1; dr <= 1; dr++) {
+                for (int dc = -1; dc <= 1; dc++) {
+                    int nr = r + dr;
+                    int nc = c + dc;
+                    if ((dr != 0 || dc != 0) && nr >= 0 && nr < dimension && nc >= 0 && nc < dimension) {
+                        table.cells[cell][table.count[cell]++] = nr * dimension + nc;
+                    }
                 }
-                findNextChar(cubes, nextPosition, words, dimension, validWords, nextPrefixIndex);
             }
         }
     }
+    return table;
+}
+
+// The neighbour table of a kernel specialised for one dimension, a compile-time constant
+template <int Dimension>
+static constexpr NeighbourTable kFixedNeighbours = buildNeighbourTable(Dimension);
+
+/**
+ * Function: getNeighbourTable
+ * --------------------
+ * Return the neighbour table of the dimension.  All of them are built on
+ * the first call, which is thread-safe, and only read afterwards.
+ */
+const NeighbourTable& getNeighbourTable(int dimension) {
+    static const vector<NeighbourTable> tables = []() {
+        vector<NeighbourTable> all;
+        for (int d = 0; d <= kMaxDimension; d++) {
+            all.push_back(buildNeighbourTable(d));
+        }
+        return all;
+    }();
+    if (dimension < 1 || dimension > kMaxDimension) {
+        error("Boards larger than " + integerToString(kMaxDimension) + "x" + integerToString(kMaxDimension)
+              + " are not supported");
+    }
+    return tables[dimension];
+}
+
+// Visited set operations, on an integer mask or on a WideMask
+template <typename Mask>
+static inline bool isVisited(Mask visited, int cell) {
+    return (visited >> cell) & 1;
+}
+
+template <typename Mask>
+static inline Mask withVisited(Mask visited, int cell) {
+    return visited | (Mask(1) << cell);
+}
+
+static inline bool isVisited(const WideMask& visited, int cell) {
+    return (visited.words[cell >> 6] >> (cell & 63)) & 1;
+}
+
+static inline WideMask withVisited(WideMask visited, int cell) {
+    visited.words[cell >> 6] |= uint64_t(1) << (cell & 63);
+    return visited;
+}
+
+/**
+ * Function: findNextChar
+ * --------------------
+ * Extend the path that ends at the cell, whose letters spell the DAWG node,
+ * to every unvisited neighbour the DAWG allows, recording new words.  rank
+ * sums the edge offsets along the path, so at a word it is the word's id.
+ * Dimension is the board size of a specialised kernel, whose neighbour
+ * table is then known at compile time, or 0 for any size.
+ */
+template <int Dimension, typename Mask>
+void findNextChar(const Dictionary& dictionary, BoggleSolver& solver, int cell, int node, int rank,
+                  Mask visited, int depth) {
+    SEARCH_STATS_NODE(depth);
+    solver.path[depth - 1] = cell;
+
+    // Check if this is a new valid word
+    if (depth >= kMinLength && isDawgWord(dictionary, node) && solver.foundStamp[rank] != solver.stamp) {
+        solver.foundStamp[rank] = solver.stamp;
+        solver.found.push_back({rank, (int) solver.paths.size(), depth});
+        solver.paths.insert(solver.paths.end(), solver.path, solver.path + depth);
+    }
+
+    // Loop all the around character
+    const NeighbourTable& neighbours = Dimension > 0 ? kFixedNeighbours<Dimension> : *solver.neighbours;
+    for (int i = 0; i < neighbours.count[cell]; i++) {
+        int next = neighbours.cells[cell][i];
+        if (isVisited(visited, next)) continue;
+        int nextRank = rank;
+        int nextNode = getDawgChild(dictionary, node, solver.letters[next], nextRank);
+        if (nextNode != -1) {
+            findNextChar<Dimension>(dictionary, solver, next, nextNode, nextRank, withVisited(visited, next),
+                                    depth + 1);
+        } else {
+            SEARCH_STATS_PRUNE();
+        }
+    }
+}
+
+/**
+ * Function: searchBoard
+ * --------------------
+ * Start a path from every cell of the board with the given kernel.
+ */
+template <int Dimension, typename Mask>
+static void searchBoard(const Dictionary& dictionary, BoggleSolver& solver, int cellCount) {
+    for (int cell = 0; cell < cellCount; cell++) {
+        SEARCH_STATS_BRANCH(true);
+        int rank = 0;
+        int node = getDawgChild(dictionary, 0, solver.letters[cell], rank);
+        if (node != -1) {
+            findNextChar<Dimension>(dictionary, solver, cell, node, rank, withVisited(Mask(), cell), 1);
+        }
+    }
+}
+
+/**
+ * Function: solveBoard
+ * --------------------
+ * Find every word on the board into the solver's result buffers, which
+ * are cleared first.  4x4 and 5x5 boards get kernels specialised for
+ * their size, with a 32-bit visited mask; other sizes share a generic one.
+ */
+void solveBoard(const Dictionary& dictionary, const string& topChars, int dimension, BoggleSolver& solver) {
+    SEARCH_STATS_BEGIN();
+    solver.neighbours = &getNeighbourTable(dimension);
+    int cellCount = dimension * dimension;
+    for (int i = 0; i < cellCount; i++) {
+        solver.letters[i] = topChars[i];
+    }
+
+    // A new stamp forgets the words of the last board without clearing the array
+    if ((int) solver.foundStamp.size() != dictionary.wordCount || solver.stamp == INT_MAX) {
+        solver.foundStamp.assign(dictionary.wordCount, 0);
+        solver.stamp = 0;
+    }
+    solver.stamp++;
+    solver.found.clear();
+    solver.paths.clear();
+
+    if (dimension == 4) {
+        searchBoard<4, uint32_t>(dictionary, solver, cellCount);
+    } else if (dimension == 5) {
+        searchBoard<5, uint32_t>(dictionary, solver, cellCount);
+    } else if (cellCount <= 64) {
+        searchBoard<0, uint64_t>(dictionary, solver, cellCount);
+    } else {
+        searchBoard<0, WideMask>(dictionary, solver, cellCount);
+    }
+    SEARCH_STATS_END("solveBoard");
+}
+
+/**
+ * Function: getFoundWord
+ * --------------------
+ * Spell out a found word from the letters along its path.
+ */
+string getFoundWord(const BoggleSolver& solver, const FoundWord& word) {
+    string text(word.length, ' ');
+    for (int i = 0; i < word.length; i++) {
+        text[i] = solver.letters[solver.paths[word.pathStart + i]];
+    }
+    return text;
+}
+
+// Spread the word ids over the table slots
+static inline int hashWordId(int id, int mask) {
+    return (int) ((uint32_t) id * 2654435761u) & mask;
 }
 
 /**
@@ -284,21 +763,64 @@ void findNextChar(
  * --------------------
  * Receive the random or input string, return all the valid words and position.
  */
-Map<string, Vector<Vector<int>>> getValidWords(const Lexicon& words, const int dimension, const string& topchars) {
-    Grid<char> cubes = getCubes(topchars, dimension);
-    Map<string, Vector<Vector<int>>> validWords;
-    for (int r = 0; r < dimension; r++) {
-        for (int c = 0; c < dimension; c++) {
-            Grid<int> currentPosition(dimension, dimension);
-            currentPosition[r][c] = 1;
-            Vector<Vector<int>> CurrentPefix;
-            CurrentPefix.add({r, c});
-            findNextChar(cubes, currentPosition, words, dimension, validWords, CurrentPefix);
-        }
+ValidWords getValidWords(const Dictionary& dictionary, const int dimension, const string& topchars) {
+    BoggleSolver solver;
+    solveBoard(dictionary, topchars, dimension, solver);
+
+    ValidWords validWords;
+    validWords.dimension = dimension;
+    validWords.letters = topchars;
+    validWords.words = move(solver.found);
+    validWords.paths = move(solver.paths);
+
+    // Keep the table at most half full
+    int slotCount = 16;
+    while (slotCount < 2 * (int) validWords.words.size()) slotCount *= 2;
+    validWords.slots.assign(slotCount, 0);
+    for (int i = 0; i < (int) validWords.words.size(); i++) {
+        int slot = hashWordId(validWords.words[i].id, slotCount - 1);
+        while (validWords.slots[slot] != 0) slot = (slot + 1) & (slotCount - 1);
+        validWords.slots[slot] = i + 1;
     }
     return validWords;
 }
 
+/**
+ * Function: findValidWord
+ * --------------------
+ * Return the index of the word among the board's words, or -1.
+ */
+int findValidWord(const Dictionary& dictionary, const ValidWords& validWords, const string& word) {
+    int node = 0;
+    int id = 0;
+    for (char c : word) {
+        node = getDawgChild(dictionary, node, c, id);
+        if (node == -1) return -1;
+    }
+    if (!isDawgWord(dictionary, node)) return -1;
+
+    int mask = validWords.slots.size() - 1;
+    for (int slot = hashWordId(id, mask); validWords.slots[slot] != 0; slot = (slot + 1) & mask) {
+        int index = validWords.slots[slot] - 1;
+        if (validWords.words[index].id == id) return index;
+    }
+    return -1;
+}
+
+/**
+ * Function: getValidWord
+ * --------------------
+ * Spell out the board's word at the index from the letters along its path.
+ */
+string getValidWord(const ValidWords& validWords, int index) {
+    const FoundWord& word = validWords.words[index];
+    string text(word.length, ' ');
+    for (int i = 0; i < word.length; i++) {
+        text[i] = validWords.letters[validWords.paths[word.pathStart + i]];
+    }
+    return text;
+}
+
 /**
  * Function: drawAllChars
  * --------------------
@@ -318,8 +840,8 @@ void drawAllChars(string topChars, int dimension) {
  * --------------------
  * Prompt the user to input words and record them, print out the final result.
  */
-void playGame(const Map<string, Vector<Vector<int>>>& validWords, Lexicon words) {
-    Set<string> usedWords;
+void playGame(const Dictionary& dictionary, const ValidWords& validWords) {
+    vector<bool> isUsed(validWords.words.size(), false);
     int humanScores = 0;
     int computerScores = 0;
 
@@ -332,7 +854,7 @@ void playGame(const Map<string, Vector<Vector<int>>>& validWords, Lexicon words)
         if (word == "") break;
 
         // Check if the word is in the lexicon
-        if (!words.contains(word)) {
+        if (!dictionaryContains(dictionary, word)) {
             cout << "Sorry, that isn't even a word." << endl;
             continue;
         }
@@ -344,38 +866,42 @@ void playGame(const Map<string, Vector<Vector<int>>>& validWords, Lexicon words)
         }
 
         // Check if the word is able to formed on the board
-        if (!validWords.containsKey(word)) {
+        int index = findValidWord(dictionary, validWords, word);
+        if (index == -1) {
             cout << "That word can't be constructed with this board." << endl;
             continue;
         }
 
         // Check if the word has been guessed
-        if (usedWords.contains(word)) {
+        if (isUsed[index]) {
             cout << "You've already guessed that word." << endl;
             continue;
         }
 
         // Congratuation! the word is valid, record it
         recordWordForPlayer(word, HUMAN);
-        usedWords.add(word);
+        isUsed[index] = true;
         humanScores += word.length() - 3;
 
         // Highlight the character and recover it
-        for (Vector<int> index : validWords[word]) {
-            highlightCube(index[0], index[1], true);
+        const FoundWord& found = validWords.words[index];
+        int dimension = validWords.dimension;
+        for (int i = 0; i < found.length; i++) {
+            int cell = validWords.paths[found.pathStart + i];
+            highlightCube(cell / dimension, cell % dimension, true);
             pause(250);
         }
-        for (Vector<int> index : validWords[word]) {
-            highlightCube(index[0], index[1], false);
+        for (int i = 0; i < found.length; i++) {
+            int cell = validWords.paths[found.pathStart + i];
+            highlightCube(cell / dimension, cell % dimension, false);
         }
     }
 
     // Computer's turn
-    Vector<string> allWords = validWords.keys();
-    for (string word : allWords) {
-        if (!usedWords.contains(word)) {
-            recordWordForPlayer(word, COMPUTER);
-            computerScores += word.length() - 3;
+    for (int i = 0; i < (int) validWords.words.size(); i++) {
+        if (!isUsed[i]) {
+            recordWordForPlayer(getValidWord(validWords, i), COMPUTER);
+            computerScores += validWords.words[i].length - 3;
         }
     }
 
@@ -391,3 +917,331 @@ void playGame(const Map<string, Vector<Vector<int>>>& validWords, Lexicon words)
         cout << "Shocker! The computer player prevailed!" << endl;
     }
 }
+
+/**
+ * Function: readBoards
+ * --------------------
+ * Read the boards in the file, one topChars string per line.
+ */
+Vector<string> readBoards(const string& path) {
+    ifstream input(path);
+    Vector<string> boards;
+    string line;
+    while (getline(input, line)) {
+        line = trim(line);
+        if (!line.empty()) boards.add(toUpperCase(line));
+    }
+    return boards;
+}
+
+/**
+ * Function: getBoardDimension
+ * --------------------
+ * Return the side of a square, purely alphabetic board, or -1.
+ */
+int getBoardDimension(const string& topChars) {
+    int dimension = (int) sqrt((double) topChars.length());
+    while (dimension * dimension < (int) topChars.length()) dimension++;
+    if (dimension * dimension != (int) topChars.length() || dimension < 1 || dimension > kMaxDimension) {
+        return -1;
+    }
+    for (char c : topChars) {
+        if (c < 'A' || c > 'Z') return -1;
+    }
+    return dimension;
+}
+
+/**
+ * Function: scoreBoard
+ * --------------------
+ * Solve one board and format its output line: the board, its score, and
+ * its words, separated by tabs.
+ */
+string scoreBoard(const Dictionary& dictionary, const string& topChars, BoggleSolver& solver) {
+    int dimension = getBoardDimension(topChars);
+    if (dimension == -1) {
+        return topChars + "\tinvalid";
+    }
+    solveBoard(dictionary, topChars, dimension, solver);
+
+    int score = 0;
+    string words;
+    for (const FoundWord& word : solver.found) {
+        score += word.length - 3;
+        words += ' ';
+        words += getFoundWord(solver, word);
+    }
+    return topChars + "\t" + integerToString(score) + "\t" + words.substr(min<size_t>(1, words.length()));
+}
+
+/**
+ * Function: solveBatch
+ * --------------------
+ * Score all the boards on threadCount threads sharing the read-only DAWG,
+ * each with its own solver.  The workers claim boards in small chunks, and
+ * the lines are written to out (if any) in board order as soon as they're
+ * ready.  Returns the elapsed seconds.
+ */
+double solveBatch(const Dictionary& dictionary, const Vector<string>& boards, int threadCount, ostream* out) {
+    static const int kChunkSize = 64;
+    SEARCH_STATS_BEGIN();
+    SEARCH_STATS_CALLER(callerStats);
+    int boardCount = boards.size();
+    vector<string> lines(out != nullptr ? boardCount : 0);
+    vector<char> isReady(boardCount, false);
+    atomic<int> nextBoard(0);
+    mutex readyLock;
+    condition_variable readyChanged;
+
+    auto startTime = chrono::steady_clock::now();
+    auto work = [&]() {
+        SEARCH_STATS_WORKER_BEGIN();
+        BoggleSolver solver;
+        while (true) {
+            int first = nextBoard.fetch_add(kChunkSize);
+            if (first >= boardCount) break;
+            int last = min(first + kChunkSize, boardCount);
+            for (int i = first; i < last; i++) {
+                string line = scoreBoard(dictionary, boards[i], solver);
+                if (out != nullptr) lines[i] = line;
+            }
+            if (out != nullptr) {
+                lock_guard<mutex> lock(readyLock);
+                for (int i = first; i < last; i++) isReady[i] = true;
+                readyChanged.notify_one();
+            }
+        }
+        SEARCH_STATS_WORKER_END(callerStats);
+    };
+
+    vector<thread> workers;
+    for (int i = 0; i < threadCount; i++) {
+        workers.emplace_back(work);
+    }
+
+    // Stream the lines in order while the workers carry on
+    if (out != nullptr) {
+        for (int i = 0; i < boardCount; i++) {
+            {
+                unique_lock<mutex> lock(readyLock);
+                readyChanged.wait(lock, [&]() { return isReady[i]; });
+            }
+            *out << lines[i] << '\n';
+            string().swap(lines[i]);
+        }
+        out->flush();
+    }
+
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    SEARCH_STATS_END("solveBatch");
+    return seconds;
+}
+
+/**
+ * Function: getBoardScore
+ * --------------------
+ * Solve the board from scratch and return its score.
+ */
+int getBoardScore(const Dictionary& dictionary, const string& topChars) {
+    BoggleSolver solver;
+    solveBoard(dictionary, topChars, getBoardDimension(topChars), solver);
+    int score = 0;
+    for (const FoundWord& word : solver.found) {
+        score += word.length - 3;
+    }
+    return score;
+}
+
+/**
+ * Function: recordPath
+ * --------------------
+ * Count one path gained or lost by the word with the id, keeping the score
+ * in step: a word scores while at least one path spells it.
+ */
+static void recordPath(BoardOptimiser& optimiser, int id, int length, int sign) {
+    int& count = optimiser.pathCounts[id];
+    count += sign;
+    if (sign > 0 && count == 1) optimiser.score += length - 3;
+    if (sign < 0 && count == 0) optimiser.score -= length - 3;
+}
+
+/**
+ * Function: countPathsFrom
+ * --------------------
+ * Count every path starting with the path so far, for the full solve.
+ */
+template <typename Mask>
+static void countPathsFrom(const Dictionary& dictionary, BoardOptimiser& optimiser, int cell, int node,
+                           int rank, Mask visited, int depth) {
+    if (depth >= kMinLength && isDawgWord(dictionary, node)) {
+        recordPath(optimiser, rank, depth, 1);
+    }
+    const NeighbourTable& neighbours = *optimiser.neighbours;
+    for (int i = 0; i < neighbours.count[cell]; i++) {
+        int next = neighbours.cells[cell][i];
+        if (isVisited(visited, next)) continue;
+        int nextRank = rank;
+        int nextNode = getDawgChild(dictionary, node, optimiser.letters[next], nextRank);
+        if (nextNode != -1) {
+            countPathsFrom(dictionary, optimiser, next, nextNode, nextRank, withVisited(visited, next), depth + 1);
+        }
+    }
+}
+
+/**
+ * Function: resetOptimiser
+ * --------------------
+ * Count all the paths of the optimiser's board from scratch.
+ */
+void resetOptimiser(const Dictionary& dictionary, BoardOptimiser& optimiser) {
+    optimiser.neighbours = &getNeighbourTable(optimiser.dimension);
+    optimiser.cellCount = optimiser.dimension * optimiser.dimension;
+    optimiser.isIncremental = optimiser.dimension >= kMinIncrementalDimension;
+    if (!optimiser.isIncremental) {
+        optimiser.board.assign(optimiser.letters, optimiser.cellCount);
+        optimiser.score = getBoardScore(dictionary, optimiser.board);
+        return;
+    }
+    optimiser.pathCounts.assign(dictionary.wordCount, 0);
+    optimiser.score = 0;
+    for (int cell = 0; cell < optimiser.cellCount; cell++) {
+        int rank = 0;
+        int node = getDawgChild(dictionary, 0, optimiser.letters[cell], rank);
+        if (node == -1) continue;
+        if (optimiser.cellCount <= 64) {
+            countPathsFrom(dictionary, optimiser, cell, node, rank, withVisited(uint64_t(), cell), 1);
+        } else {
+            countPathsFrom(dictionary, optimiser, cell, node, rank, withVisited(WideMask(), cell), 1);
+        }
+    }
+}
+
+/**
+ * Function: extendForwards
+ * --------------------
+ * The second half of a walk through the changed cell: extend the word
+ * after it, recording every complete word with the optimiser's sign.
+ */
+template <typename Mask>
+static void extendForwards(const Dictionary& dictionary, const Dictionary& gaddag, BoardOptimiser& optimiser,
+                           int cell, int node, Mask visited, int prefixLength, int suffixLength) {
+    int length = prefixLength + suffixLength;
+    if (length >= kMinLength && isDawgWord(gaddag, node)) {
+        // Spell the word through the dictionary to find its id
+        int wordNode = 0;
+        int id = 0;
+        for (int i = prefixLength - 1; i >= 0; i--) {
+            wordNode = getDawgChild(dictionary, wordNode, optimiser.letters[optimiser.reversePath[i]], id);
+        }
+        for (int i = 0; i < suffixLength; i++) {
+            wordNode = getDawgChild(dictionary, wordNode, optimiser.letters[optimiser.forwardPath[i]], id);
+        }
+        recordPath(optimiser, id, length, optimiser.sign);
+        optimiser.changes.push_back({id, length, optimiser.sign});
+    }
+
+    const NeighbourTable& neighbours = *optimiser.neighbours;
+    for (int i = 0; i < neighbours.count[cell]; i++) {
+        int next = neighbours.cells[cell][i];
+        if (isVisited(visited, next)) continue;
+        int nextNode = getDawgChild(gaddag, node, optimiser.letters[next]);
+        if (nextNode != -1) {
+            optimiser.forwardPath[suffixLength] = next;
+            extendForwards(dictionary, gaddag, optimiser, next, nextNode, withVisited(visited, next),
+                           prefixLength, suffixLength + 1);
+        }
+    }
+}
+
+/**
+ * Function: extendBackwards
+ * --------------------
+ * The first half of a walk through the changed cell: read the word
+ * backwards from it, and at every step also try ending the prefix there
+ * and carrying on forwards from the changed cell.
+ */
+template <typename Mask>
+static void extendBackwards(const Dictionary& dictionary, const Dictionary& gaddag, BoardOptimiser& optimiser,
+                            int cell, int node, Mask visited, int prefixLength) {
+    optimiser.reversePath[prefixLength - 1] = cell;
+
+    int separatorNode = getDawgChild(gaddag, node, kGaddagSeparator);
+    if (separatorNode != -1) {
+        extendForwards(dictionary, gaddag, optimiser, optimiser.reversePath[0], separatorNode, visited, prefixLength, 0);
+    }
+
+    const NeighbourTable& neighbours = *optimiser.neighbours;
+    for (int i = 0; i < neighbours.count[cell]; i++) {
+        int next = neighbours.cells[cell][i];
+        if (isVisited(visited, next)) continue;
+        int nextNode = getDawgChild(gaddag, node, optimiser.letters[next]);
+        if (nextNode != -1) {
+            extendBackwards(dictionary, gaddag, optimiser, next, nextNode, withVisited(visited, next), prefixLength + 1);
+        }
+    }
+}
+
+/**
+ * Function: recordPathsThrough
+ * --------------------
+ * Record every word path through the cell with the given sign.
+ */
+static void recordPathsThrough(const Dictionary& dictionary, const Dictionary& gaddag,
+                               BoardOptimiser& optimiser, int cell, int sign) {
+    optimiser.sign = sign;
+    int node = getDawgChild(gaddag, 0, optimiser.letters[cell]);
+    if (node == -1) return;
+    if (optimiser.cellCount <= 64) {
+        extendBackwards(dictionary, gaddag, optimiser, cell, node, withVisited(uint64_t(), cell), 1);
+    } else {
+        extendBackwards(dictionary, gaddag, optimiser, cell, node, withVisited(WideMask(), cell), 1);
+    }
+}
+
+/**
+ * Function: changeCell
+ * --------------------
+ * Put a new letter on the cell and update the score incrementally: only
+ * the paths through that cell are lost and found again.
+ */
+void changeCell(const Dictionary& dictionary, const Dictionary& gaddag, BoardOptimiser& optimiser,
+                int cell, char letter) {
+    if (!optimiser.isIncremental) {
+        optimiser.previousScore = optimiser.score;
+        optimiser.letters[cell] = letter;
+        optimiser.board[cell] = letter;
+        solveBoard(dictionary, optimiser.board, optimiser.dimension, optimiser.solver);
+        optimiser.score = 0;
+        for (const FoundWord& word : optimiser.solver.found) {
+            optimiser.score += word.length - 3;
+        }
+        return;
+    }
+    optimiser.changes.clear();
+    recordPathsThrough(dictionary, gaddag, optimiser, cell, -1);
+    optimiser.letters[cell] = letter;
+    recordPathsThrough(dictionary, gaddag, optimiser, cell, 1);
+}
+
+/**
+ * Function: undoChange
+ * --------------------
+ * Put the old letter back, replaying the last change's paths in reverse.
+ */
+void undoChange(BoardOptimiser& optimiser, int cell, char letter) {
+    if (!optimiser.isIncremental) {
+        optimiser.score = optimiser.previousScore;
+        optimiser.letters[cell] = letter;
+        optimiser.board[cell] = letter;
+        return;
+    }
+    for (int i = optimiser.changes.size() - 1; i >= 0; i--) {
+        const PathChange& change = optimiser.changes[i];
+        recordPath(optimiser, change.id, change.length, -change.sign);
+    }
+    optimiser.changes.clear();
+    optimiser.letters[cell] = letter;
+}
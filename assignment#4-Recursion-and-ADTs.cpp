@@ -1,13 +1,455 @@
 #include "RecursionToTheRescue.h"
 #include "map.h"
 #include <climits>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include "Disasters.h"
 #include "grid.h"
+#include "search-stats.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 using namespace std;
 
+// Below this many patients the parallel search isn't worth starting threads for
+static const int kMinParallelPatients = 12;
+
+// The top of the doctor search tree is split into about this many subproblems per thread
+static const int kSubproblemsPerThread = 16;
+
+// The most failed disaster search states remembered at once, shared by the component threads
+static const size_t kMaxFailedStates = 1 << 22;
+
+// The memory the doctor search may spend on remembering failed states, shared by its threads
+static const size_t kDoctorCacheBytes = 64 << 20;
+
+// How many doctor cache slots to start with per patient, before the budget caps it
+static const size_t kDoctorCacheSlotsPerPatient = 4096;
+
+// The most search steps a local repair of the schedule may take before giving up
+static const long long kRepairStepLimit = 20000;
+
 /* * * * Doctors Without Orders * * * */
 
+/**
+ * How well the doctor search's cache of failed states worked.
+ */
+struct DoctorCacheStats {
+    long long lookups = 0;
+    long long hits = 0;
+    long long stores = 0;
+    long long evictions = 0;
+
+    double hitRate() const {
+        return lookups == 0 ? 0 : (double) hits / lookups;
+    }
+};
+
+/**
+ * The states the doctor search has already seen fail, so reaching one again through
+ * another order of assignments is cut at once.  A state is the next patient and the
+ * multiset of the doctors' hours left, identified by a 64-bit hash and checked against a
+ * second, independent one, so a hit is wrong only if both collide.  The table is 4-way
+ * set associative and holds a fixed number of slots; a new state evicts the least
+ * recently used one of its set.
+ */
+struct FailedStateCache {
+    struct Slot {
+        uint64_t key = 0;           // 0 if empty
+        uint64_t check = 0;
+        uint64_t lastUse = 0;
+    };
+    vector<Slot> slots;
+    size_t setMask = 0;
+    uint64_t clock = 0;
+    DoctorCacheStats stats;
+};
+
+// A strong 64-bit mixer, for hashing the hours left of every doctor independently
+static inline uint64_t mixHash(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+// The mixer of the check hash, on inputs far from any the key hash sees
+static inline uint64_t mixCheck(uint64_t value) {
+    return mixHash(value ^ 0xD6E8FEB86659FD93ull);
+}
+
+/**
+ * Sizes the cache to about the given number of slots, rounded down to a power of two
+ * number of sets.
+ */
+void resetFailedStateCache(FailedStateCache& cache, size_t slotCount) {
+    size_t setCount = 1;
+    while (setCount * 2 * 4 <= slotCount) setCount *= 2;
+    cache.slots.assign(setCount * 4, FailedStateCache::Slot());
+    cache.setMask = setCount - 1;
+    cache.clock = 0;
+    cache.stats = DoctorCacheStats();
+}
+
+// The slots of the key's set, chosen by the bits above the lowest, which every key has set
+static inline FailedStateCache::Slot* getCacheSet(FailedStateCache& cache, uint64_t key) {
+    return &cache.slots[((key >> 1) & cache.setMask) * 4];
+}
+
+/**
+ * Returns whether the state is known to fail, refreshing it if so.
+ */
+bool isKnownFailure(FailedStateCache& cache, uint64_t key, uint64_t check) {
+    cache.stats.lookups++;
+    FailedStateCache::Slot* set = getCacheSet(cache, key);
+    for (int way = 0; way < 4; way++) {
+        if (set[way].key == key && set[way].check == check) {
+            set[way].lastUse = ++cache.clock;
+            cache.stats.hits++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Remembers that the state fails, in an empty slot of its set or else the least recently
+ * used one.
+ */
+void recordFailure(FailedStateCache& cache, uint64_t key, uint64_t check) {
+    FailedStateCache::Slot* set = getCacheSet(cache, key);
+    FailedStateCache::Slot* victim = &set[0];
+    for (int way = 1; way < 4; way++) {
+        if (set[way].lastUse < victim->lastUse) victim = &set[way];
+    }
+    if (victim->key != 0) cache.stats.evictions++;
+    victim->key = key;
+    victim->check = check;
+    victim->lastUse = ++cache.clock;
+    cache.stats.stores++;
+}
+
+/**
+ * The state of the doctor search.  Doctors and patients are integer ids into flat
+ * arrays, the patients sorted by decreasing hours needed, so the search only adjusts
+ * numbers in place and the schedule map is built once, from the final assignment.
+ */
+struct DoctorSearch {
+    vector<int> patientIds;         // index into the caller's patients, in search order
+    vector<int> hoursNeeded;        // per patient, in decreasing order
+    vector<long long> suffixHours;  // hours needed by patient i and all the ones after it
+    vector<int> hoursLeft;          // per doctor
+    vector<int> assignment;         // the doctor seeing each patient
+    vector<vector<int>> tried;      // per patient, the free hours of the doctors already tried
+    const atomic<bool>* isCancelled = nullptr;  // set once another thread has found a schedule
+    uint64_t capacityHash = 0;      // the sum of mixHash of every doctor's hours left
+    uint64_t capacityCheck = 0;     // the same with mixCheck, to verify cache hits
+    FailedStateCache* cache = nullptr;
+    long long stepsLeft = -1;       // the search gives up when this reaches 0, never if negative
+};
+
+// Whether the search was cut short, by another thread's schedule or by its step limit
+static inline bool isSearchStopped(const DoctorSearch& search) {
+    return search.stepsLeft == 0
+        || (search.isCancelled != nullptr && search.isCancelled->load(memory_order_relaxed));
+}
+
+/**
+ * Recomputes the hashes of the doctors' hours left.  Adding up a hash per doctor makes
+ * them the same for any order of the same hours, as if they had been sorted, and lets
+ * the search update them in O(1) when one doctor's hours change.
+ */
+void hashCapacities(DoctorSearch& search) {
+    search.capacityHash = 0;
+    search.capacityCheck = 0;
+    for (int left : search.hoursLeft) {
+        search.capacityHash += mixHash(left);
+        search.capacityCheck += mixCheck(left);
+    }
+}
+
+// Changes one doctor's hours left, keeping the hashes in step
+static inline void setHoursLeft(DoctorSearch& search, int doctor, int hours) {
+    search.capacityHash += mixHash(hours) - mixHash(search.hoursLeft[doctor]);
+    search.capacityCheck += mixCheck(hours) - mixCheck(search.hoursLeft[doctor]);
+    search.hoursLeft[doctor] = hours;
+}
+
+/**
+ * Assigns the patients from the given one onwards to doctors with enough hours left,
+ * returning whether it succeeded.  A branch is cut as soon as the doctors' usable hours
+ * (those with room for at least the smallest patient) fall short of the hours still
+ * needed, and doctors with the same hours left are only tried once, since swapping them
+ * gives the same subproblem.  With a cache, states that already failed are cut too.
+ *
+ * @param search  The search state, updated in place and restored on failure.
+ * @param patient The index of the next patient to assign.
+ * @return Whether every remaining patient could be assigned.
+ */
+bool canAllPatientsBeSeenHelper(DoctorSearch& search, int patient) {
+    SEARCH_STATS_NODE(patient);
+    int patientCount = search.hoursNeeded.size();
+    if (patient == patientCount) return true;
+    if (isSearchStopped(search)) return false;
+    if (search.stepsLeft > 0) search.stepsLeft--;
+
+    // bound on the capacity that can still be used at all
+    int smallest = search.hoursNeeded[patientCount - 1];
+    long long usableHours = 0;
+    for (int left : search.hoursLeft) {
+        if (left >= smallest) usableHours += left;
+    }
+    if (usableHours < search.suffixHours[patient]) {
+        SEARCH_STATS_PRUNE();
+        return false;
+    }
+
+    uint64_t key = (search.capacityHash ^ mixHash(~(uint64_t) patient)) | 1;
+    uint64_t check = search.capacityCheck + patient;
+    if (search.cache != nullptr) {
+        bool isKnown = isKnownFailure(*search.cache, key, check);
+        SEARCH_STATS_MEMO(isKnown);
+        if (isKnown) return false;
+    }
+
+    int hours = search.hoursNeeded[patient];
+    vector<int>& tried = search.tried[patient];
+    tried.clear();
+    for (int doctor = 0; doctor < (int) search.hoursLeft.size(); doctor++) {
+        int left = search.hoursLeft[doctor];
+        if (left < hours) continue;
+        if (find(tried.begin(), tried.end(), left) != tried.end()) {
+            SEARCH_STATS_PRUNE();
+            continue;
+        }
+        tried.push_back(left);
+
+        SEARCH_STATS_BRANCH(patient == 0);
+        setHoursLeft(search, doctor, left - hours);
+        search.assignment[patient] = doctor;
+        if (canAllPatientsBeSeenHelper(search, patient + 1)) return true;
+        setHoursLeft(search, doctor, left);
+    }
+
+    // a search cut short proves nothing
+    if (search.cache != nullptr && !isSearchStopped(search)) recordFailure(*search.cache, key, check);
+    return false;
+}
+
+/**
+ * Builds the search state of the doctors and patients, the hardest patients first since
+ * they have the fewest doctors to choose from.
+ */
+DoctorSearch makeDoctorSearch(const Vector<Doctor>& doctors, const Vector<Patient>& patients) {
+    DoctorSearch search;
+    int patientCount = patients.size();
+    for (int i = 0; i < patientCount; i++) search.patientIds.push_back(i);
+    stable_sort(search.patientIds.begin(), search.patientIds.end(), [&](int a, int b) {
+        return patients[a].hoursNeeded > patients[b].hoursNeeded;
+    });
+
+    for (const Doctor& doctor : doctors) {
+        search.hoursLeft.push_back(doctor.hoursFree);
+    }
+    search.suffixHours.assign(patientCount + 1, 0);
+    for (int i = 0; i < patientCount; i++) {
+        search.hoursNeeded.push_back(patients[search.patientIds[i]].hoursNeeded);
+    }
+    for (int i = patientCount - 1; i >= 0; i--) {
+        search.suffixHours[i] = search.suffixHours[i + 1] + search.hoursNeeded[i];
+    }
+    search.assignment.assign(patientCount, -1);
+    search.tried.resize(patientCount);
+    hashCapacities(search);
+    return search;
+}
+
+/**
+ * Turns a complete assignment into the schedule map, with every doctor as a key.
+ */
+Map<string, Set<string>> buildSchedule(const Vector<Doctor>& doctors,
+                                       const Vector<Patient>& patients,
+                                       const DoctorSearch& search) {
+    Map<string, Set<string>> schedule;
+    for (const Doctor& doctor : doctors) {
+        schedule[doctor.name] = {};
+    }
+    for (int i = 0; i < (int) search.assignment.size(); i++) {
+        schedule[doctors[search.assignment[i]].name].add(patients[search.patientIds[i]].name);
+    }
+    return schedule;
+}
+
+/**
+ * Lists the assignments of the first depth patients that the search would explore, with
+ * the same pruning, as the subproblems of a parallel search.  A schedule found within that
+ * depth is listed too, as a complete assignment.
+ *
+ * @param search      The search state, restored on return.
+ * @param patient     The index of the next patient to assign.
+ * @param depth       The number of patients every subproblem assigns.
+ * @param subproblems Collects the assignment of each subproblem.
+ */
+void splitDoctorSearch(DoctorSearch& search, int patient, int depth, vector<vector<int>>& subproblems) {
+    int patientCount = search.hoursNeeded.size();
+    if (patient == depth || patient == patientCount) {
+        subproblems.emplace_back(search.assignment.begin(), search.assignment.begin() + patient);
+        return;
+    }
+
+    int smallest = search.hoursNeeded[patientCount - 1];
+    long long usableHours = 0;
+    for (int left : search.hoursLeft) {
+        if (left >= smallest) usableHours += left;
+    }
+    if (usableHours < search.suffixHours[patient]) return;
+
+    int hours = search.hoursNeeded[patient];
+    vector<int> tried;
+    for (int doctor = 0; doctor < (int) search.hoursLeft.size(); doctor++) {
+        int left = search.hoursLeft[doctor];
+        if (left < hours || find(tried.begin(), tried.end(), left) != tried.end()) continue;
+        tried.push_back(left);
+
+        search.hoursLeft[doctor] -= hours;
+        search.assignment[patient] = doctor;
+        splitDoctorSearch(search, patient + 1, depth, subproblems);
+        search.hoursLeft[doctor] += hours;
+    }
+}
+
+/**
+ * Same as canAllPatientsBeSeen, but searches on threadCount threads.  The top levels of
+ * the search tree are split into subproblems, dealt out to one queue per thread; a thread
+ * takes work from the back of its own queue and steals from the front of the others'
+ * once it runs dry.  The first thread to find a schedule raises a shared cancel flag,
+ * which stops all the others at their next step.  Every thread has its own cache of
+ * failed states, splitting kDoctorCacheBytes between them.
+ *
+ * @param doctors     The list of the doctors available to work.
+ * @param patients    The list of the patients that need to be seen.
+ * @param schedule    An outparameter that will be filled in with the schedule, should one exist.
+ * @param threadCount How many threads to search on.
+ * @param stats       If not null, filled in with how well the caches worked, over all threads.
+ * @return Whether or not a schedule was found.
+ */
+bool canAllPatientsBeSeenInParallel(const Vector<Doctor>& doctors,
+                                    const Vector<Patient>& patients,
+                                    Map<string, Set<string>>& schedule,
+                                    int threadCount,
+                                    DoctorCacheStats* stats) {
+    SEARCH_STATS_BEGIN();
+    DoctorSearch search = makeDoctorSearch(doctors, patients);
+    int patientCount = patients.size();
+    bool isParallel = threadCount > 1 && patientCount >= kMinParallelPatients;
+    if (!isParallel) threadCount = 1;
+    size_t slotCount = min(kDoctorCacheBytes / sizeof(FailedStateCache::Slot) / threadCount,
+                           kDoctorCacheSlotsPerPatient * max(1, patientCount));
+    if (stats != nullptr) *stats = DoctorCacheStats();
+
+    if (!isParallel) {
+        FailedStateCache cache;
+        resetFailedStateCache(cache, slotCount);
+        search.cache = &cache;
+        bool isFound = canAllPatientsBeSeenHelper(search, 0);
+        if (stats != nullptr) *stats = cache.stats;
+        SEARCH_STATS_END("canAllPatientsBeSeen");
+        if (!isFound) return false;
+        schedule = buildSchedule(doctors, patients, search);
+        return true;
+    }
+
+    // go one level deeper until there's enough work to balance
+    vector<vector<int>> subproblems;
+    for (int depth = 1; depth <= patientCount; depth++) {
+        subproblems.clear();
+        splitDoctorSearch(search, 0, depth, subproblems);
+        if ((int) subproblems.size() >= threadCount * kSubproblemsPerThread) break;
+    }
+
+    struct WorkQueue {
+        mutex lock;
+        deque<int> subproblems;
+    };
+    vector<WorkQueue> queues(threadCount);
+    for (int i = 0; i < (int) subproblems.size(); i++) {
+        queues[i % threadCount].subproblems.push_back(i);
+    }
+
+    atomic<bool> isFound(false);
+    DoctorSearch solution;
+    mutex statsLock;
+    SEARCH_STATS_CALLER(callerStats);
+    auto takeWork = [&](int worker) {
+        for (int i = 0; i < threadCount; i++) {
+            WorkQueue& queue = queues[(worker + i) % threadCount];
+            lock_guard<mutex> lock(queue.lock);
+            if (queue.subproblems.empty()) continue;
+            int subproblem;
+            if (i == 0) {
+                subproblem = queue.subproblems.back();
+                queue.subproblems.pop_back();
+            } else {
+                subproblem = queue.subproblems.front();
+                queue.subproblems.pop_front();
+            }
+            return subproblem;
+        }
+        return -1;
+    };
+    auto work = [&](int worker) {
+        SEARCH_STATS_WORKER_BEGIN();
+        FailedStateCache cache;
+        resetFailedStateCache(cache, slotCount);
+        DoctorSearch local = search;
+        local.isCancelled = &isFound;
+        local.cache = &cache;
+        for (int subproblem = takeWork(worker); subproblem != -1 && !isFound; subproblem = takeWork(worker)) {
+            SEARCH_STATS_BRANCH(true);
+
+            // replay the subproblem's assignment on a fresh copy of the capacities
+            local.hoursLeft = search.hoursLeft;
+            const vector<int>& prefix = subproblems[subproblem];
+            for (int i = 0; i < (int) prefix.size(); i++) {
+                local.assignment[i] = prefix[i];
+                local.hoursLeft[prefix[i]] -= local.hoursNeeded[i];
+            }
+            hashCapacities(local);
+            if (canAllPatientsBeSeenHelper(local, prefix.size())) {
+                bool wasFound = false;
+                if (isFound.compare_exchange_strong(wasFound, true)) solution = local;
+                break;
+            }
+        }
+
+        if (stats != nullptr) {
+            lock_guard<mutex> lock(statsLock);
+            stats->lookups += cache.stats.lookups;
+            stats->hits += cache.stats.hits;
+            stats->stores += cache.stats.stores;
+            stats->evictions += cache.stats.evictions;
+        }
+        SEARCH_STATS_WORKER_END(callerStats);
+    };
+
+    vector<thread> workers;
+    for (int i = 0; i < threadCount; i++) {
+        workers.emplace_back(work, i);
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    SEARCH_STATS_END("canAllPatientsBeSeen");
+    if (!isFound) return false;
+    schedule = buildSchedule(doctors, patients, solution);
+    return true;
+}
+
 /**
  * Given a list of doctors and a list of patients, determines whether all the patients can
  * be seen. If so, this function fills in the schedule outparameter with a map from doctors
@@ -18,71 +460,493 @@ using namespace std;
  * @param schedule An outparameter that will be filled in with the schedule, should one exist.
  * @return Whether or not a schedule was found.
  */
+bool canAllPatientsBeSeen(const Vector<Doctor>& doctors,
+                          const Vector<Patient>& patients,
+                          Map<string, Set<string>>& schedule) {
+    int threadCount = max(1, (int) thread::hardware_concurrency());
+    return canAllPatientsBeSeenInParallel(doctors, patients, schedule, threadCount, nullptr);
+}
+
+/**
+ * A change to the roster.  A doctor both removed and added under the same name has had
+ * their free hours changed.
+ */
+struct RosterChange {
+    Vector<string> removedDoctors;
+    Vector<Doctor> addedDoctors;
+    Vector<string> removedPatients;
+    Vector<Patient> addedPatients;
+};
 
+/**
+ * How a schedule was brought up to date after a roster change.
+ */
+enum RescheduleOutcome {
+    REPAIRED,       // only the affected patients were moved
+    RESCHEDULED,    // the repair failed, the whole roster was scheduled again
+    UNSCHEDULABLE   // no schedule exists for the new roster
+};
 
-void canAllPatientsBeSeenHelper(const Vector<Doctor>& doctors,
-                                Vector<Patient>& patients,
-                                Map<string, Set<string>>& schedule,
-                                Vector<int>& patientsTime,
-                                bool& isFound,
-                                Map<string, Set<string>>& finalSchedule) {
-    // base case: all the patients been seen, return true
-    if (isFound) return;
-    if (patients.isEmpty()) {
-        bool isVaLid = true;
-        int n = doctors.size();
-        for (int i = 0; i < n; i++) {
-            if (doctors[i].hoursFree < patientsTime[i]) {
-                isVaLid = false;
-            }
+/**
+ * Applies a change to the roster and brings its schedule up to date.  The patients of a
+ * removed doctor, of a doctor now over their hours, new patients and any patient the old
+ * schedule left out are the affected ones; first they alone are assigned to the hours the
+ * other doctors have left, with a search limited to kRepairStepLimit steps.  Only if that
+ * fails is the whole roster scheduled from scratch.
+ *
+ * @param doctors  The doctors, updated with the change.
+ * @param patients The patients, updated with the change.
+ * @param schedule A schedule of the old roster, updated to one of the new roster if it exists;
+ *                 otherwise it keeps only the patients that still fit where they were.
+ * @param change   The doctors and patients removed and added.
+ * @return How the schedule was brought up to date.
+ */
+RescheduleOutcome rescheduleAfterChange(Vector<Doctor>& doctors,
+                                        Vector<Patient>& patients,
+                                        Map<string, Set<string>>& schedule,
+                                        const RosterChange& change) {
+    // apply the change to the roster, collecting the patients left without a doctor
+    Set<string> removedPatients;
+    for (const string& name : change.removedPatients) removedPatients.add(name);
+    Vector<Patient> remainingPatients;
+    for (const Patient& patient : patients) {
+        if (!removedPatients.contains(patient.name)) remainingPatients.add(patient);
+    }
+    patients = remainingPatients;
+
+    for (const string& name : change.removedDoctors) {
+        schedule.remove(name);
+    }
+    Set<string> removedDoctors;
+    for (const string& name : change.removedDoctors) removedDoctors.add(name);
+    Vector<Doctor> remainingDoctors;
+    for (const Doctor& doctor : doctors) {
+        if (!removedDoctors.contains(doctor.name)) remainingDoctors.add(doctor);
+    }
+    for (const Doctor& doctor : change.addedDoctors) {
+        remainingDoctors.add(doctor);
+        if (!schedule.containsKey(doctor.name)) schedule[doctor.name] = {};
+    }
+    doctors = remainingDoctors;
+    for (const Patient& patient : change.addedPatients) {
+        patients.add(patient);
+    }
+
+    // what every doctor has left once the unaffected patients stay where they are
+    Map<string, int> hoursNeeded;
+    for (const Patient& patient : patients) hoursNeeded[patient.name] = patient.hoursNeeded;
+    Vector<Doctor> doctorsLeft;
+    Set<string> placed;
+    for (const Doctor& doctor : doctors) {
+        Set<string> kept;
+        int hoursUsed = 0;
+        for (const string& name : schedule[doctor.name]) {
+            if (!hoursNeeded.containsKey(name) || placed.contains(name)) continue;
+            kept.add(name);
+            hoursUsed += hoursNeeded[name];
         }
-        if (isVaLid) {
-            isFound = true;
-            finalSchedule = schedule;
+        if (hoursUsed > doctor.hoursFree) {
+            kept.clear();
+            hoursUsed = 0;
         }
-    } else {
-        // put the first patient in the schedule, consider every doctor
-        Patient p = patients[0];
-        patients.remove(0);
-        int n = doctors.size();
+        placed += kept;
+        schedule[doctor.name] = kept;
+        doctorsLeft.add({doctor.name, doctor.hoursFree - hoursUsed});
+    }
 
-        // loop the schedule, each doctor
-        for (int i = 0; i < n; i++) {
-            // confirm if the patients can be seen
-            if (doctors[i].hoursFree >= patientsTime[i] + p.hoursNeeded) {
+    // local repair: every patient no doctor kept, with a bounded search
+    Vector<Patient> affected;
+    for (const Patient& patient : patients) {
+        if (!placed.contains(patient.name)) affected.add(patient);
+    }
+    DoctorSearch repair = makeDoctorSearch(doctorsLeft, affected);
+    repair.stepsLeft = kRepairStepLimit;
+    if (canAllPatientsBeSeenHelper(repair, 0)) {
+        for (int i = 0; i < affected.size(); i++) {
+            schedule[doctorsLeft[repair.assignment[i]].name].add(affected[repair.patientIds[i]].name);
+        }
+        return REPAIRED;
+    }
+
+    Map<string, Set<string>> fullSchedule;
+    if (!canAllPatientsBeSeen(doctors, patients, fullSchedule)) return UNSCHEDULABLE;
+    schedule = fullSchedule;
+    return RESCHEDULED;
+}
 
-                patientsTime[i] += p.hoursNeeded;
-                schedule[doctors[i].name].add(p.name);
+/* * * * Disaster Planning * * * */
 
-                canAllPatientsBeSeenHelper(doctors, patients, schedule, patientsTime, isFound, finalSchedule);
+/**
+ * The road network with cities as dense indexes.  The cities a supply city covers (the
+ * city and those a road away) are a bitset of wordCount 64-bit words, so covering them
+ * is a word-wide AND-NOT.  Straight from the road network both sides are the closed
+ * neighbourhood; after reduceCityGraph a city may need no cover or be no candidate.
+ */
+struct CityGraph {
+    Vector<string> names;
+    int wordCount = 0;
+    vector<uint64_t> neighbourhoods;    // the cities city i covers, starting at i * wordCount
+    vector<vector<int>> neighbours;     // the cities able to cover each city, as a list
+    vector<uint64_t> mustCover;         // the cities that need covering
+    int maxNeighbourhood = 0;           // the most cities one supply city can cover
+};
 
-                patientsTime[i] -= p.hoursNeeded;
-                schedule[doctors[i].name].remove(p.name);
+/**
+ * How much reduceCityGraph shrank a road network.
+ */
+struct DisasterReductionStats {
+    int citiesBefore = 0;
+    int roadsBefore = 0;
+    int forcedCities = 0;               // supply cities every smallest choice can contain
+    int citiesAfter = 0;                // cities left for the search, needing cover or candidates
+    int candidatesAfter = 0;
+    int mustCoverAfter = 0;
+    int roadsAfter = 0;                 // candidate to uncovered city links, not counting a city itself
+};
+
+/**
+ * The largest budget a set of uncovered cities failed with, and the check hash the
+ * set must match as well as its key.
+ */
+struct FailedCover {
+    uint64_t check = 0;
+    int budget = 0;
+};
+
+/**
+ * The state of the disaster search: a stack holding the uncovered cities of every depth
+ * as a bitset, and the supply cities chosen so far.
+ */
+struct DisasterSearch {
+    const CityGraph* graph = nullptr;
+    vector<uint64_t> uncovered;         // depth d's bitset starts at d * wordCount
+    vector<vector<int>> candidates;     // per depth, the cities to try, best first
+    vector<int> gains;                  // scratch, the newly covered cities per candidate
+    vector<int> chosen;
+    unordered_map<uint64_t, FailedCover>* failedStates = nullptr;  // by uncovered set hash
+    size_t maxFailedStates = 0;
+};
+
+/**
+ * Builds the dense graph of the road network, adding the reverse of any one-way road.
+ */
+CityGraph makeCityGraph(const Map<string, Set<string>>& roadNetwork) {
+    CityGraph graph;
+    Map<string, int> ids;
+    for (string city : roadNetwork) {
+        ids[city] = graph.names.size();
+        graph.names.add(city);
+    }
+    int cityCount = graph.names.size();
+    graph.wordCount = (cityCount + 63) / 64;
+    graph.neighbourhoods.assign((size_t) cityCount * graph.wordCount, 0);
+    auto link = [&](int a, int b) {
+        graph.neighbourhoods[(size_t) a * graph.wordCount + b / 64] |= uint64_t(1) << (b % 64);
+    };
+    for (int city = 0; city < cityCount; city++) {
+        link(city, city);
+        for (string neighbour : roadNetwork[graph.names[city]]) {
+            if (!ids.containsKey(neighbour)) continue;
+            link(city, ids[neighbour]);
+            link(ids[neighbour], city);
+        }
+    }
+
+    graph.neighbours.resize(cityCount);
+    for (int city = 0; city < cityCount; city++) {
+        const uint64_t* bits = &graph.neighbourhoods[(size_t) city * graph.wordCount];
+        for (int word = 0; word < graph.wordCount; word++) {
+            for (uint64_t rest = bits[word]; rest != 0; rest &= rest - 1) {
+                graph.neighbours[city].push_back(word * 64 + __builtin_ctzll(rest));
             }
         }
-        // add the patient back to the vector
-        patients.insert(0, p);
+        graph.maxNeighbourhood = max(graph.maxNeighbourhood, (int) graph.neighbours[city].size());
+    }
+    graph.mustCover.assign(graph.wordCount, 0);
+    for (int city = 0; city < cityCount; city++) {
+        graph.mustCover[city / 64] |= uint64_t(1) << (city % 64);
     }
+    return graph;
 }
 
-bool canAllPatientsBeSeen(const Vector<Doctor>& doctors,
-                          const Vector<Patient>& patients,
-                          Map<string, Set<string>>& schedule) {
+/**
+ * Shrinks the road network before the search with rules that keep a smallest choice of
+ * supply cities, repeated until none applies:
+ * <ul>
+ * <li>A city only one candidate can cover forces that candidate.  This picks isolated
+ *     cities themselves and the neighbour of every dead end.</li>
+ * <li>A candidate covering no more uncovered cities than another is dropped, as the
+ *     other can always take its place.  Of twins covering the same cities one is kept.</li>
+ * <li>A city covered by every candidate able to cover another uncovered city needs no
+ *     cover of its own.  Of twins covered by the same candidates one is kept.</li>
+ * </ul>
+ *
+ * @param graph  The road network, straight from makeCityGraph.
+ * @param forced An outparameter filled in with the forced supply cities.
+ * @param stats  If not null, filled in with how much the network shrank.
+ * @return The rest of the network, with its own city indexes.
+ */
+CityGraph reduceCityGraph(const CityGraph& graph, Vector<string>& forced, DisasterReductionStats* stats) {
+    int cityCount = graph.names.size();
+    int wordCount = graph.wordCount;
+    vector<bool> isCandidate(cityCount, true);
+    vector<bool> isUncovered(cityCount, true);
+    vector<int> forcedIds;
+    vector<uint64_t> candidateBits(graph.mustCover);
+    vector<uint64_t> common(wordCount);
+    auto countCovered = [&](int candidate) {
+        int count = 0;
+        for (int city : graph.neighbours[candidate]) count += isUncovered[city];
+        return count;
+    };
+    auto countCovering = [&](int city) {
+        int count = 0;
+        for (int candidate : graph.neighbours[city]) count += isCandidate[candidate];
+        return count;
+    };
+    auto dropCandidate = [&](int candidate) {
+        isCandidate[candidate] = false;
+        candidateBits[candidate / 64] &= ~(uint64_t(1) << (candidate % 64));
+    };
+
+    for (bool isChanged = true; isChanged; ) {
+        isChanged = false;
+
+        // an uncovered city with a single candidate forces it
+        for (int city = 0; city < cityCount; city++) {
+            if (!isUncovered[city] || countCovering(city) != 1) continue;
+            for (int candidate : graph.neighbours[city]) {
+                if (!isCandidate[candidate]) continue;
+                forcedIds.push_back(candidate);
+                dropCandidate(candidate);
+                for (int covered : graph.neighbours[candidate]) isUncovered[covered] = false;
+            }
+            isChanged = true;
+        }
 
-    Vector<int> patientsTime;
-    Map<string, Set<string>> scheduleTest;
-    int n = doctors.size();
-    for (int i = 0; i < n; i++) {
-        scheduleTest[doctors[i].name] = {};
-        patientsTime.add(0);
+        // a candidate is dominated by any candidate covering all its uncovered cities, which are
+        // the candidates in the intersection of those cities' neighbourhoods
+        for (int candidate = 0; candidate < cityCount; candidate++) {
+            if (!isCandidate[candidate]) continue;
+            common = candidateBits;
+            common[candidate / 64] &= ~(uint64_t(1) << (candidate % 64));
+            int covered = 0;
+            for (int city : graph.neighbours[candidate]) {
+                if (!isUncovered[city]) continue;
+                covered++;
+                const uint64_t* bits = &graph.neighbourhoods[(size_t) city * wordCount];
+                for (int word = 0; word < wordCount; word++) common[word] &= bits[word];
+            }
+            bool isDominated = covered == 0;
+            for (int word = 0; word < wordCount && !isDominated; word++) {
+                for (uint64_t rest = common[word]; rest != 0 && !isDominated; rest &= rest - 1) {
+                    int other = word * 64 + __builtin_ctzll(rest);
+                    isDominated = other < candidate || countCovered(other) > covered;
+                }
+            }
+            if (isDominated) {
+                dropCandidate(candidate);
+                isChanged = true;
+            }
+        }
+
+        // a city is covered for free if some uncovered city's candidates all cover it; that city
+        // shares a candidate with it, so it is at most two roads away
+        for (int city = 0; city < cityCount; city++) {
+            if (!isUncovered[city]) continue;
+            int covering = countCovering(city);
+            const uint64_t* bits = &graph.neighbourhoods[(size_t) city * wordCount];
+            bool isImplied = false;
+            for (int candidate : graph.neighbours[city]) {
+                if (!isCandidate[candidate]) continue;
+                for (int other : graph.neighbours[candidate]) {
+                    if (other == city || !isUncovered[other]) continue;
+                    bool isSubset = true;
+                    int otherCovering = 0;
+                    for (int otherCandidate : graph.neighbours[other]) {
+                        if (!isCandidate[otherCandidate]) continue;
+                        otherCovering++;
+                        if (!(bits[otherCandidate / 64] >> (otherCandidate % 64) & 1)) {
+                            isSubset = false;
+                            break;
+                        }
+                    }
+                    if (isSubset && (otherCovering < covering || other < city)) {
+                        isImplied = true;
+                        break;
+                    }
+                }
+                if (isImplied) break;
+            }
+            if (isImplied) {
+                isUncovered[city] = false;
+                isChanged = true;
+            }
+        }
+    }
+
+    // renumber what is left
+    CityGraph reduced;
+    vector<int> ids(cityCount, -1);
+    for (int city = 0; city < cityCount; city++) {
+        if (!isCandidate[city] && !isUncovered[city]) continue;
+        ids[city] = reduced.names.size();
+        reduced.names.add(graph.names[city]);
+    }
+    int reducedCount = reduced.names.size();
+    reduced.wordCount = (reducedCount + 63) / 64;
+    reduced.neighbourhoods.assign((size_t) reducedCount * reduced.wordCount, 0);
+    reduced.neighbours.resize(reducedCount);
+    reduced.mustCover.assign(reduced.wordCount, 0);
+    int candidateCount = 0;
+    int mustCoverCount = 0;
+    int links = 0;
+    for (int city = 0; city < cityCount; city++) {
+        int id = ids[city];
+        if (id == -1) continue;
+        if (isUncovered[city]) {
+            mustCoverCount++;
+            reduced.mustCover[id / 64] |= uint64_t(1) << (id % 64);
+            for (int candidate : graph.neighbours[city]) {
+                if (isCandidate[candidate]) reduced.neighbours[id].push_back(ids[candidate]);
+            }
+        }
+        if (isCandidate[city]) {
+            candidateCount++;
+            int covered = 0;
+            for (int other : graph.neighbours[city]) {
+                if (!isUncovered[other]) continue;
+                reduced.neighbourhoods[(size_t) id * reduced.wordCount + ids[other] / 64] |=
+                        uint64_t(1) << (ids[other] % 64);
+                covered++;
+                if (other != city) links++;
+            }
+            reduced.maxNeighbourhood = max(reduced.maxNeighbourhood, covered);
+        }
     }
-    bool isFound = false;
-    Vector<Patient> patientsCopy = patients;
-    canAllPatientsBeSeenHelper(doctors, patientsCopy, scheduleTest, patientsTime, isFound, schedule);
-    return isFound;
+
+    Vector<string> forcedNames;
+    for (int city : forcedIds) forcedNames.add(graph.names[city]);
+    forced = forcedNames;
+    if (stats != nullptr) {
+        int degrees = 0;
+        for (int city = 0; city < cityCount; city++) degrees += graph.neighbours[city].size() - 1;
+        stats->citiesBefore = cityCount;
+        stats->roadsBefore = degrees / 2;
+        stats->forcedCities = forcedIds.size();
+        stats->citiesAfter = reducedCount;
+        stats->candidatesAfter = candidateCount;
+        stats->mustCoverAfter = mustCoverCount;
+        stats->roadsAfter = links;
+    }
+    return reduced;
 }
 
-/* * * * Disaster Planning * * * */
+/**
+ * Tries to cover the cities still uncovered at the given depth with at most numCities
+ * more supply cities.  It branches on the uncovered city with the fewest cities able to
+ * cover it, trying the ones that cover the most first, and gives up once even the
+ * largest neighbourhood could not cover the rest in time.
+ *
+ * @param search    The search state; on success chosen holds the supply cities.
+ * @param depth     The number of supply cities chosen so far.
+ * @param numCities How many more supply cities can be chosen.
+ * @return Whether the rest can be covered.
+ */
+bool canBeMadeDisasterReadyHelper(DisasterSearch& search, int depth, int numCities) {
+    SEARCH_STATS_NODE(depth);
+    const CityGraph& graph = *search.graph;
+    int wordCount = graph.wordCount;
+    const uint64_t* uncovered = search.uncovered.data() + (size_t) depth * wordCount;
+
+    // count the uncovered cities and find the hardest one to cover
+    int uncoveredCount = 0;
+    int hardest = -1;
+    for (int word = 0; word < wordCount; word++) {
+        uncoveredCount += __builtin_popcountll(uncovered[word]);
+        for (uint64_t rest = uncovered[word]; rest != 0; rest &= rest - 1) {
+            int city = word * 64 + __builtin_ctzll(rest);
+            if (hardest == -1 || graph.neighbours[city].size() < graph.neighbours[hardest].size()) {
+                hardest = city;
+            }
+        }
+    }
+    if (uncoveredCount == 0) return true;
+    if (numCities <= 0) return false;
+
+    // lower bound: every supply city covers at most maxNeighbourhood cities
+    if (graph.maxNeighbourhood == 0) return false;
+    if ((uncoveredCount + graph.maxNeighbourhood - 1) / graph.maxNeighbourhood > numCities) {
+        SEARCH_STATS_PRUNE();
+        return false;
+    }
+
+    // the same uncovered cities may already have failed with as many supply cities or more
+    uint64_t stateHash = 0;
+    uint64_t stateCheck = 0;
+    if (search.failedStates != nullptr) {
+        for (int word = 0; word < wordCount; word++) {
+            stateHash = (stateHash ^ uncovered[word]) * 0x9E3779B97F4A7C15ull;
+            stateHash ^= stateHash >> 32;
+            stateCheck = stateCheck * 0xC2B2AE3D27D4EB4Full + mixHash(uncovered[word]);
+        }
+        auto failed = search.failedStates->find(stateHash);
+        bool isKnown = failed != search.failedStates->end() && failed->second.check == stateCheck
+                       && failed->second.budget >= numCities;
+        SEARCH_STATS_MEMO(isKnown);
+        if (isKnown) return false;
+    }
+
+    vector<int>& candidates = search.candidates[depth];
+    candidates = graph.neighbours[hardest];
+    for (int candidate : candidates) {
+        const uint64_t* bits = &graph.neighbourhoods[(size_t) candidate * wordCount];
+        int gain = 0;
+        for (int word = 0; word < wordCount; word++) {
+            gain += __builtin_popcountll(uncovered[word] & bits[word]);
+        }
+        search.gains[candidate] = gain;
+    }
+    sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+        return search.gains[a] > search.gains[b];
+    });
+
+    uint64_t* next = search.uncovered.data() + (size_t) (depth + 1) * wordCount;
+    for (int candidate : candidates) {
+        SEARCH_STATS_BRANCH(depth == 0);
+        const uint64_t* bits = &graph.neighbourhoods[(size_t) candidate * wordCount];
+        for (int word = 0; word < wordCount; word++) {
+            next[word] = uncovered[word] & ~bits[word];
+        }
+        search.chosen.push_back(candidate);
+        if (canBeMadeDisasterReadyHelper(search, depth + 1, numCities - 1)) return true;
+        search.chosen.pop_back();
+    }
+
+    if (search.failedStates != nullptr && search.failedStates->size() < search.maxFailedStates) {
+        FailedCover& failed = (*search.failedStates)[stateHash];
+        if (failed.check != stateCheck) failed = {stateCheck, 0};
+        failed.budget = max(failed.budget, numCities);
+    }
+    return false;
+}
+
+/**
+ * Builds the search state for choosing at most maxCities supply cities of the graph,
+ * with the cities that need cover uncovered.
+ */
+DisasterSearch makeDisasterSearch(const CityGraph& graph, int maxCities) {
+    int cityCount = graph.names.size();
+    int depthCount = max(0, min(maxCities, cityCount)) + 1;
+
+    DisasterSearch search;
+    search.graph = &graph;
+    search.uncovered.assign((size_t) (depthCount + 1) * graph.wordCount, 0);
+    copy(graph.mustCover.begin(), graph.mustCover.end(), search.uncovered.begin());
+    search.candidates.resize(depthCount);
+    search.gains.resize(cityCount);
+    return search;
+}
 
 /**
  * Given a transportation grid for a country or region, along with the number of cities where disaster
@@ -94,123 +958,338 @@ bool canAllPatientsBeSeen(const Vector<Doctor>& doctors,
  * bidirectional: if there's a road from City A to City B, then there's a road from City B back to
  * City A as well.
  *
+ * The network is shrunk by reduceCityGraph first, and its forced cities count against the budget.
+ *
  * @param roadNetwork The underlying transportation network.
  * @param numCities   How many cities you can afford to put supplies in.
  * @param locations   An outparameter filled in with which cities to choose if a solution exists.
+ * @param stats       If not null, filled in with how much the reduction shrank the network.
  * @return Whether a solution exists.
  */
-
-void canBeMadeDisasterReadyHelper(const Map<string, Set<string>>& roadNetwork,
-                                  int numCities,
-                                  Set<string>& finalLocations,
-                                  Set<string> retainLocations,
-                                  Set<string>& locations,
-                                  bool& isFound) {
-    // if any solution is found
-    if (isFound) return;
-
-    // if there's no location retained
-    if (retainLocations.isEmpty()) {
-        isFound = true;
-        finalLocations = locations;
-        return;
-    } else {
-        if (numCities == 0) return;
-        // choose a uncovered city
-        string uncoverCity = retainLocations.first();
-        Set<string> uncoverCities = roadNetwork[uncoverCity];
-        uncoverCities.add(uncoverCity);
-        for (string currentLocation : uncoverCities) {
-            Set<string> currentNetwork = roadNetwork[currentLocation];
-            currentNetwork.add(currentLocation);
-            Set<string> newRetainLocations = retainLocations - currentNetwork;
-            locations += currentLocation;
-            canBeMadeDisasterReadyHelper(roadNetwork, numCities - 1, finalLocations, newRetainLocations, locations, isFound);
-            locations -= currentLocation;
-        }
+bool canBeMadeDisasterReady(const Map<string, Set<string>>& roadNetwork,
+                            int numCities,
+                            Set<string>& locations,
+                            DisasterReductionStats* stats) {
+    SEARCH_STATS_BEGIN();
+    Vector<string> forced;
+    CityGraph graph = reduceCityGraph(makeCityGraph(roadNetwork), forced, stats);
+    int budget = numCities - forced.size();
+    int cityCount = graph.names.size();
+    DisasterSearch search = makeDisasterSearch(graph, budget);
+    bool isReady = budget >= 0 && canBeMadeDisasterReadyHelper(search, 0, min(budget, cityCount));
+    SEARCH_STATS_END("canBeMadeDisasterReady");
+    if (!isReady) return false;
+    Set<string> finalLocations;
+    for (string city : forced) {
+        finalLocations.add(city);
     }
+    for (int city : search.chosen) {
+        finalLocations.add(graph.names[city]);
+    }
+    locations = finalLocations;
+    return true;
 }
 
 bool canBeMadeDisasterReady(const Map<string, Set<string>>& roadNetwork,
                             int numCities,
                             Set<string>& locations) {
-    bool isFound = false;
-    Set<string> retainLocations;
-    Set<string> chosenLocations;
-    for (string city : roadNetwork) {
-        retainLocations.add(city);
+    return canBeMadeDisasterReady(roadNetwork, numCities, locations, nullptr);
+}
+
+/**
+ * Finds the fewest supply cities covering the graph by iterative deepening: it tries
+ * budgets from the lower bound up until one succeeds.  The failed states are kept
+ * between budgets, since a set of uncovered cities that failed with some budget fails
+ * with every smaller one too.  States are identified by a 64-bit hash of the uncovered
+ * bitset and checked against a second one, a colliding state replacing the one stored,
+ * and at most maxFailedStates of them are kept.
+ *
+ * @param graph           One connected piece of the road network, possibly reduced.
+ * @param chosen          An outparameter filled in with the supply cities.
+ * @param maxFailedStates The most failed states to remember.
+ * @return The number of supply cities needed.
+ */
+int findMinimumSupplyCities(const CityGraph& graph, vector<int>& chosen, size_t maxFailedStates) {
+    int cityCount = graph.names.size();
+    int mustCoverCount = 0;
+    for (uint64_t word : graph.mustCover) mustCoverCount += __builtin_popcountll(word);
+    chosen.clear();
+    if (mustCoverCount == 0) return 0;
+    unordered_map<uint64_t, FailedCover> failedStates;
+    DisasterSearch search = makeDisasterSearch(graph, cityCount);
+    search.failedStates = &failedStates;
+    search.maxFailedStates = maxFailedStates;
+    int budget = (mustCoverCount + graph.maxNeighbourhood - 1) / graph.maxNeighbourhood;
+    while (!canBeMadeDisasterReadyHelper(search, 0, budget)) {
+        budget++;
+    }
+    chosen = search.chosen;
+    return budget;
+}
+
+/**
+ * Given a transportation grid, returns the fewest cities where disaster supplies have to be
+ * stockpiled so that each city either has supplies or is connected to a city that does.
+ * The connected components of the network are reduced and solved independently, in parallel,
+ * largest first.  The threads split kMaxFailedStates evenly, so the failed states remembered
+ * at any one time stay within it whatever the number of threads.
+ *
+ * @param roadNetwork The underlying transportation network.
+ * @param locations   An outparameter filled in with the cities to choose.
+ * @param stats       If not null, filled in with how much the reductions shrank the components,
+ *                    added up.
+ * @return The minimum number of supply cities.
+ */
+int minCitiesForDisasterReadiness(const Map<string, Set<string>>& roadNetwork,
+                                  Set<string>& locations,
+                                  DisasterReductionStats* stats = nullptr) {
+    // split the network into connected components
+    SEARCH_STATS_BEGIN();
+    SEARCH_STATS_CALLER(callerStats);
+    CityGraph graph = makeCityGraph(roadNetwork);
+    int cityCount = graph.names.size();
+    vector<int> component(cityCount, -1);
+    vector<Map<string, Set<string>>> componentNetworks;
+    for (int start = 0; start < cityCount; start++) {
+        if (component[start] != -1) continue;
+        int id = componentNetworks.size();
+        componentNetworks.emplace_back();
+        Map<string, Set<string>>& network = componentNetworks.back();
+        vector<int> stack = {start};
+        component[start] = id;
+        while (!stack.empty()) {
+            int city = stack.back();
+            stack.pop_back();
+            Set<string>& roads = network[graph.names[city]];
+            for (int neighbour : graph.neighbours[city]) {
+                if (neighbour != city) roads.add(graph.names[neighbour]);
+                if (component[neighbour] == -1) {
+                    component[neighbour] = id;
+                    stack.push_back(neighbour);
+                }
+            }
+        }
+    }
+    int componentCount = componentNetworks.size();
+    vector<int> order(componentCount);
+    for (int i = 0; i < componentCount; i++) order[i] = i;
+    sort(order.begin(), order.end(), [&](int a, int b) {
+        return componentNetworks[a].size() > componentNetworks[b].size();
+    });
+
+    // solve the components on a pool of threads, each claiming the next largest
+    int threadCount = max(1, min(componentCount, (int) thread::hardware_concurrency()));
+    size_t maxFailedStates = kMaxFailedStates / threadCount;
+    vector<int> counts(componentCount, 0);
+    vector<Set<string>> componentLocations(componentCount);
+    vector<DisasterReductionStats> componentStats(componentCount);
+    atomic<int> nextComponent(0);
+    auto work = [&]() {
+        SEARCH_STATS_WORKER_BEGIN();
+        for (int i = nextComponent++; i < componentCount; i = nextComponent++) {
+            int id = order[i];
+            Vector<string> forced;
+            CityGraph piece = reduceCityGraph(makeCityGraph(componentNetworks[id]), forced, &componentStats[id]);
+            vector<int> chosen;
+            counts[id] = forced.size() + findMinimumSupplyCities(piece, chosen, maxFailedStates);
+            for (string city : forced) {
+                componentLocations[id].add(city);
+            }
+            for (int city : chosen) {
+                componentLocations[id].add(piece.names[city]);
+            }
+        }
+        SEARCH_STATS_WORKER_END(callerStats);
+    };
+    vector<thread> workers;
+    for (int i = 0; i < threadCount; i++) {
+        workers.emplace_back(work);
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+
+    int total = 0;
+    Set<string> finalLocations;
+    DisasterReductionStats totals;
+    for (int id = 0; id < componentCount; id++) {
+        total += counts[id];
+        finalLocations += componentLocations[id];
+        const DisasterReductionStats& piece = componentStats[id];
+        totals.citiesBefore += piece.citiesBefore;
+        totals.roadsBefore += piece.roadsBefore;
+        totals.forcedCities += piece.forcedCities;
+        totals.citiesAfter += piece.citiesAfter;
+        totals.candidatesAfter += piece.candidatesAfter;
+        totals.mustCoverAfter += piece.mustCoverAfter;
+        totals.roadsAfter += piece.roadsAfter;
     }
-    canBeMadeDisasterReadyHelper(roadNetwork, numCities, locations, retainLocations, chosenLocations, isFound);
-    return isFound;
+    locations = finalLocations;
+    if (stats != nullptr) *stats = totals;
+    SEARCH_STATS_END("minCitiesForDisasterReadiness");
+    return total;
 }
 
 /* * * * Winning the Election * * * */
 
+// A vote count no set of states reaches, with room to add a state's votes without overflow
+static const long long kUnreachableVotes = LLONG_MAX / 2;
+
 /**
- * Given a list of the states in the election, including their popular and electoral vote
- * totals, and the number of electoral votes needed, as well as the index of the lowest-indexed
- * state to consider, returns information about how few popular votes you'd need in order to
- * win that at least that many electoral votes.
- *
- * @param electoralVotesNeeded the minimum number of electoral votes needed
- * @param states All the states in the election (plus DC, if appropriate)
- * @param minStateIndex the lowest index in the states Vector that should be considered
- * @param minInfoGrid Save the result that has been calculated
- */
-MinInfo minPopularVoteToGetAtLeast(int electoralVotesNeeded,
-                                   const Vector<State>& states,
-                                   int minStateIndex,
-                                   Grid<MinInfo>& minInfoGrid) {
-    // the fundamental case
-    if (electoralVotesNeeded <= 0) {
-        return {0, {}};
-    }
-
-    // if the result was saved
-    if (minInfoGrid[electoralVotesNeeded - 1][minStateIndex].popularVotesNeeded != -1) {
-        return minInfoGrid[electoralVotesNeeded - 1][minStateIndex];
-    }
-
-    // get the current information
-    State currentState = states[minStateIndex];
-    int currentPopularVoteNeeded = (currentState.popularVotes / 2) + 1;
-    int currentElectoralVoteNeeded = currentState.electoralVotes;
-
-    // the lase state, base case
-    if (minStateIndex == states.size() - 1) {
-        if (electoralVotesNeeded > currentElectoralVoteNeeded) {
-            minInfoGrid[electoralVotesNeeded - 1][minStateIndex] = {INT_MAX, {}};
-            return {INT_MAX, {}};
-        } else {
-            MinInfo lastInfo = {currentPopularVoteNeeded, {states[minStateIndex]}};
-            minInfoGrid[electoralVotesNeeded - 1][minStateIndex] = lastInfo;
-            return lastInfo;
+ * The fewest popular votes for every number of electoral votes from 0 up to a cap, with
+ * what's needed to read back the states behind any of them.
+ */
+struct VoteCurve {
+    Vector<State> states;
+    int cap = 0;
+    vector<long long> minVotes;     // per electoral votes, winning at least that many
+    size_t rowWords = 0;
+    vector<uint64_t> isTaken;       // bit e of state i's row: state i is in the best set for e
+};
+
+/**
+ * Adds one state to the knapsack: next[e] is the better of current[e] and taking the
+ * state on top of current[e - electoral], and isBetter[e] is 1 where taking it won.  The
+ * loops are plain element-wise compares and selects over separate arrays, which the
+ * compiler turns into SIMD min/blend instructions; with 32-bit counts that needs nothing
+ * beyond SSE2.
+ */
+template <typename Votes>
+static void addStateToRow(const Votes* current, Votes* next, uint8_t* isBetter,
+                          int cap, int electoral, Votes popular) {
+    int split = min(electoral, cap + 1);
+    Votes fromNothing = current[0] + popular;
+    for (int e = 0; e < split; e++) {
+        isBetter[e] = fromNothing < current[e];
+        next[e] = fromNothing < current[e] ? fromNothing : current[e];
+    }
+    const Votes* from = current - electoral;
+    for (int e = split; e <= cap; e++) {
+        Votes withState = from[e] + popular;
+        isBetter[e] = withState < current[e];
+        next[e] = withState < current[e] ? withState : current[e];
+    }
+}
+
+/**
+ * Packs the byte flags of addStateToRow into a row of the choice bitmap, eight at a time
+ * with a multiply that gathers the low bit of every byte of a little-endian word.
+ */
+static void packStateFlags(const uint8_t* isBetter, uint64_t* taken, size_t rowWords) {
+    for (size_t word = 0; word < rowWords; word++) {
+        uint64_t bits = 0;
+        for (int octet = 0; octet < 8; octet++) {
+            uint64_t flags;
+            memcpy(&flags, &isBetter[word * 64 + octet * 8], sizeof(flags));
+            bits |= ((flags * 0x0102040810204080ull) >> 56) << (octet * 8);
         }
+        taken[word] = bits;
     }
+}
 
-    // put this state into the result
-    int newElectoralVotesNeeded = electoralVotesNeeded - currentElectoralVoteNeeded;
-    MinInfo nextWithCurrent = minPopularVoteToGetAtLeast(newElectoralVotesNeeded, states, minStateIndex + 1, minInfoGrid);
+/**
+ * Runs the knapsack over every state with rows of the given count type, whose
+ * unreachable value must leave room to add any state's votes.  A state's bit is set
+ * wherever it improved the row, which is all reconstruction needs.
+ */
+template <typename Votes>
+static void fillVoteRows(VoteCurve& curve, Votes unreachable) {
+    vector<Votes> current(curve.cap + 1, unreachable);
+    vector<Votes> next(curve.cap + 1);
+    vector<uint8_t> isBetter(curve.rowWords * 64, 0);
+    current[0] = 0;
+    for (int i = 0; i < curve.states.size(); i++) {
+        int electoral = curve.states[i].electoralVotes;
+        if (electoral <= 0) continue;
+        addStateToRow<Votes>(current.data(), next.data(), isBetter.data(), curve.cap, electoral,
+                             curve.states[i].popularVotes / 2 + 1);
 
-    // put this state not into the result
-    MinInfo nextWithoutCurrent = minPopularVoteToGetAtLeast(electoralVotesNeeded, states, minStateIndex + 1, minInfoGrid);
+        packStateFlags(isBetter.data(), &curve.isTaken[curve.rowWords * i], curve.rowWords);
+        current.swap(next);
+    }
 
-    if (nextWithCurrent.popularVotesNeeded == INT_MAX) {
-        minInfoGrid[electoralVotesNeeded - 1][minStateIndex] = nextWithoutCurrent;
-        return nextWithoutCurrent;
+    curve.minVotes.resize(curve.cap + 1);
+    for (int e = 0; e <= curve.cap; e++) {
+        curve.minVotes[e] = current[e] >= unreachable ? kUnreachableVotes : current[e];
     }
+}
 
-    nextWithCurrent.popularVotesNeeded += currentPopularVoteNeeded;
-    nextWithCurrent.statesUsed.insert(0, currentState);
+/**
+ * Fills in the curve of the states up to the cap, a 0/1 knapsack solved bottom up one
+ * state at a time over two rows of vote counts.  The rows are 32-bit, twice as many
+ * per vector, whenever the votes of all the states together fit.
+ */
+VoteCurve fillVoteCurve(const Vector<State>& states, int cap) {
+    VoteCurve curve;
+    curve.states = states;
+    curve.cap = max(0, cap);
+    curve.rowWords = curve.cap / 64 + 1;
+    curve.isTaken.assign(curve.rowWords * states.size(), 0);
 
-    // compare and return the result
-    if (nextWithCurrent.popularVotesNeeded > nextWithoutCurrent.popularVotesNeeded) {
-        minInfoGrid[electoralVotesNeeded - 1][minStateIndex] = nextWithoutCurrent;
-        return nextWithoutCurrent;
+    long long totalVotes = 0;
+    for (const State& state : states) {
+        totalVotes += state.popularVotes / 2 + 1;
+    }
+    if (totalVotes < INT_MAX / 2) {
+        fillVoteRows<int>(curve, INT_MAX / 2);
     } else {
-        minInfoGrid[electoralVotesNeeded - 1][minStateIndex] = nextWithCurrent;
-        return nextWithCurrent;
+        fillVoteRows<long long>(curve, kUnreachableVotes);
+    }
+    return curve;
+}
+
+/**
+ * Builds the whole curve of the election in one pass: the fewest popular votes for every
+ * electoral vote threshold from 0 to the total.
+ *
+ * @param states All the states in the election (plus DC, if appropriate)
+ * @return The curve, to read thresholds from with getVoteCurvePoint.
+ */
+VoteCurve getPopularVoteCurve(const Vector<State>& states) {
+    int electoralVotesSum = 0;
+    for (const State& state : states) {
+        electoralVotesSum += max(0, state.electoralVotes);
     }
+    return fillVoteCurve(states, electoralVotesSum);
+}
+
+/**
+ * Reads one threshold off the curve, reconstructing its states only now.
+ *
+ * @param curve     A curve from getPopularVoteCurve.
+ * @param threshold The minimum number of electoral votes needed.
+ * @return The fewest popular votes, INT_MAX if even every state isn't enough.
+ */
+MinInfo getVoteCurvePoint(const VoteCurve& curve, int threshold) {
+    int needed = max(0, threshold);
+    if (needed > curve.cap || curve.minVotes[needed] >= kUnreachableVotes) return {INT_MAX, {}};
+    MinInfo result = {(int) min<long long>(curve.minVotes[needed], INT_MAX), {}};
+    Vector<State> reversed;
+    for (int i = curve.states.size() - 1, e = needed; i >= 0 && e > 0; i--) {
+        if ((curve.isTaken[curve.rowWords * i + e / 64] >> (e % 64)) & 1) {
+            reversed.add(curve.states[i]);
+            e = max(0, e - curve.states[i].electoralVotes);
+        }
+    }
+    for (int i = reversed.size() - 1; i >= 0; i--) {
+        result.statesUsed.add(reversed[i]);
+    }
+    return result;
+}
+
+/**
+ * Given a list of the states in the election, including their popular and electoral vote
+ * totals, and the number of electoral votes needed, returns information about how few
+ * popular votes you'd need in order to win at least that many electoral votes.  The
+ * knapsack only runs up to the votes needed, so it keeps O(E) integers per row and one
+ * bit per state and vote count.
+ *
+ * @param electoralVotesNeeded the minimum number of electoral votes needed
+ * @param states All the states in the election (plus DC, if appropriate)
+ * @return The fewest popular votes, INT_MAX if even every state isn't enough.
+ */
+MinInfo minPopularVoteToGetAtLeast(int electoralVotesNeeded, const Vector<State>& states) {
+    return getVoteCurvePoint(fillVoteCurve(states, electoralVotesNeeded), electoralVotesNeeded);
 }
 
 /**
@@ -231,30 +1310,175 @@ MinInfo minPopularVoteToWin(const Vector<State>& states) {
 
     int electoralVotesNeeded = (electoralVotesSum / 2) + 1;
 
-    // the grid we used in the helper function to memopization
-    Grid<MinInfo> minInfoGrid (electoralVotesNeeded, states.size());
+    return minPopularVoteToGetAtLeast(electoralVotesNeeded, states);
+}
 
-    // initialize the grid with {-1, {}}, distinguish with {-1, {}}
-    minInfoGrid.fill({-1, {}});
+/**
+ * The knapsack rows of every prefix and every suffix of the states, for what-if questions
+ * that change one state: the answer combines the rows on either side of it, in O(E)
+ * instead of another O(N * E) fill.  It holds 2 * (N + 1) rows of E + 1 vote counts,
+ * where E is the total of the electoral votes.
+ */
+struct WhatIfSolver {
+    Vector<State> states;
+    int cap = 0;
+    vector<long long> prefix;       // row i, over the states before i, starts at i * (cap + 1)
+    vector<long long> suffix;       // row i, over state i and the ones after it
+    size_t rowWords = 0;
+    vector<uint64_t> prefixTaken;   // bit e of row i: state i improved prefix row i + 1 at e
+    vector<uint64_t> suffixTaken;   // bit e of row i: state i improved suffix row i at e
+};
 
-    // calculate the sentinel values of each i
-    Vector<int> sentinelValues;
-    for (int i = 0; i < states.size(); i++) {
-        int currentSentinelValues = 0;
-        for (int j = i; j < states.size(); j++) {
-            currentSentinelValues += states[j].electoralVotes;
+/**
+ * Fills in the prefix and suffix rows of the states.
+ *
+ * @param states All the states in the election (plus DC, if appropriate)
+ * @return The solver to ask what-if questions of.
+ */
+WhatIfSolver makeWhatIfSolver(const Vector<State>& states) {
+    WhatIfSolver solver;
+    solver.states = states;
+    for (const State& state : states) {
+        solver.cap += max(0, state.electoralVotes);
+    }
+    int stateCount = states.size();
+    size_t rowSize = solver.cap + 1;
+    solver.rowWords = solver.cap / 64 + 1;
+    solver.prefix.assign(rowSize * (stateCount + 1), kUnreachableVotes);
+    solver.suffix.assign(rowSize * (stateCount + 1), kUnreachableVotes);
+    solver.prefixTaken.assign(solver.rowWords * stateCount, 0);
+    solver.suffixTaken.assign(solver.rowWords * stateCount, 0);
+    vector<uint8_t> isBetter(solver.rowWords * 64, 0);
+
+    solver.prefix[0] = 0;
+    for (int i = 0; i < stateCount; i++) {
+        const long long* current = &solver.prefix[rowSize * i];
+        long long* next = &solver.prefix[rowSize * (i + 1)];
+        if (states[i].electoralVotes <= 0) {
+            copy(current, current + rowSize, next);
+            continue;
         }
-        sentinelValues.add(currentSentinelValues);
+        addStateToRow<long long>(current, next, isBetter.data(), solver.cap, states[i].electoralVotes,
+                                 states[i].popularVotes / 2 + 1);
+        packStateFlags(isBetter.data(), &solver.prefixTaken[solver.rowWords * i], solver.rowWords);
     }
 
-    // if the v and i is higher than the sentinel value, reassign it as INT_MAX
-    for (int i = 0; i < electoralVotesNeeded; i++) {
-        for (int j = 0; j < states.size(); j++) {
-            if (i > sentinelValues[j]) {
-                minInfoGrid[i][j] = {INT_MAX, {}};
-            }
+    solver.suffix[rowSize * stateCount] = 0;
+    for (int i = stateCount - 1; i >= 0; i--) {
+        const long long* current = &solver.suffix[rowSize * (i + 1)];
+        long long* next = &solver.suffix[rowSize * i];
+        if (states[i].electoralVotes <= 0) {
+            copy(current, current + rowSize, next);
+            continue;
         }
+        addStateToRow<long long>(current, next, isBetter.data(), solver.cap, states[i].electoralVotes,
+                                 states[i].popularVotes / 2 + 1);
+        packStateFlags(isBetter.data(), &solver.suffixTaken[solver.rowWords * i], solver.rowWords);
     }
+    return solver;
+}
 
-    return minPopularVoteToGetAtLeast(electoralVotesNeeded, states, 0, minInfoGrid);
+/**
+ * Answers how few popular votes would win the presidency if one state were replaced by
+ * another: the best split of the electoral votes needed between the states before it,
+ * plus perhaps the changed state, and the states after it.  A change that raises the
+ * votes needed past the base total is solved from scratch instead.
+ *
+ * @param solver     The solver of the base election.
+ * @param stateIndex The index of the state to change.
+ * @param changed    Its new name and vote totals.
+ * @return Information about how few votes you'd need to win the changed election.
+ */
+MinInfo minPopularVoteWhatIf(const WhatIfSolver& solver, int stateIndex, const State& changed) {
+    const Vector<State>& states = solver.states;
+    int total = solver.cap - max(0, states[stateIndex].electoralVotes) + max(0, changed.electoralVotes);
+    int needed = total / 2 + 1;
+    if (needed > solver.cap) {
+        Vector<State> changedStates = states;
+        changedStates[stateIndex] = changed;
+        return minPopularVoteToWin(changedStates);
+    }
+
+    size_t rowSize = solver.cap + 1;
+    const long long* before = &solver.prefix[rowSize * stateIndex];
+    const long long* after = &solver.suffix[rowSize * (stateIndex + 1)];
+    int electoral = changed.electoralVotes;
+    long long popular = changed.popularVotes / 2 + 1;
+
+    // the best number of votes to win before the state (or with it), the rest after it
+    long long best = kUnreachableVotes;
+    int bestSplit = -1;
+    bool isChangedTaken = false;
+    for (int split = 0; split <= needed; split++) {
+        long long without = before[split];
+        long long with = electoral > 0 ? before[max(0, split - electoral)] + popular : kUnreachableVotes;
+        long long votes = min(without, with) + after[needed - split];
+        if (votes < best) {
+            best = votes;
+            bestSplit = split;
+            isChangedTaken = with < without;
+        }
+    }
+    if (best >= kUnreachableVotes) return {INT_MAX, {}};
+
+    // read the states back from both bitmaps
+    MinInfo result = {(int) min<long long>(best, INT_MAX), {}};
+    Vector<State> reversed;
+    int e = bestSplit;
+    if (isChangedTaken) e = max(0, e - electoral);
+    for (int i = stateIndex - 1; i >= 0 && e > 0; i--) {
+        if ((solver.prefixTaken[solver.rowWords * i + e / 64] >> (e % 64)) & 1) {
+            reversed.add(states[i]);
+            e = max(0, e - states[i].electoralVotes);
+        }
+    }
+    for (int i = reversed.size() - 1; i >= 0; i--) {
+        result.statesUsed.add(reversed[i]);
+    }
+    if (isChangedTaken) result.statesUsed.add(changed);
+    e = needed - bestSplit;
+    for (int i = stateIndex + 1; i < states.size() && e > 0; i++) {
+        if ((solver.suffixTaken[solver.rowWords * i + e / 64] >> (e % 64)) & 1) {
+            result.statesUsed.add(states[i]);
+            e = max(0, e - states[i].electoralVotes);
+        }
+    }
+    return result;
+}
+
+/**
+ * Answers a batch of what-if questions on threadCount threads sharing the read-only
+ * solver, each question changing one state of the base election.
+ *
+ * @param solver       The solver of the base election.
+ * @param stateIndexes The index of the state each question changes.
+ * @param changes      The new state of each question.
+ * @param threadCount  How many threads to answer on.
+ * @return The answer to each question, in order.
+ */
+Vector<MinInfo> minPopularVoteWhatIfs(const WhatIfSolver& solver,
+                                      const Vector<int>& stateIndexes,
+                                      const Vector<State>& changes,
+                                      int threadCount) {
+    int questionCount = stateIndexes.size();
+    vector<MinInfo> answers(questionCount);
+    atomic<int> nextQuestion(0);
+    auto work = [&]() {
+        for (int i = nextQuestion++; i < questionCount; i = nextQuestion++) {
+            answers[i] = minPopularVoteWhatIf(solver, stateIndexes[i], changes[i]);
+        }
+    };
+    vector<thread> workers;
+    for (int i = 0; i < max(1, threadCount); i++) {
+        workers.emplace_back(work);
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+
+    Vector<MinInfo> results;
+    for (const MinInfo& answer : answers) {
+        results.add(answer);
+    }
+    return results;
 }
@@ -0,0 +1,195 @@
+/**
+ * File: benchmark.cpp
+ * -------------------
+ * Implements the benchmark harness.  It replaces the global operator new
+ * and delete to count allocations, so it must be linked into the driver
+ * only, never into a program.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <vector>
+#include "benchmark.h"
+#include "error.h"
+using namespace std;
+
+static const int kDefaultSamples = 11;
+static const double kSampleSeconds = 0.02;     // the shortest batch worth timing
+static const long long kMaxIterations = 1 << 24;
+
+static atomic<long long> allocationCount(0);
+static atomic<long long> allocationBytes(0);
+
+static double getMedian(vector<double> values);
+
+/**
+ * The replaced allocation functions.  The array and nothrow forms of the
+ * standard library call these, so they are counted too; the over-aligned
+ * forms are not.  GCC inlines delete into its callers and then takes the
+ * free for a mismatch with the built-in operator new, not knowing it was
+ * replaced, so that warning is off for these definitions.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    allocationBytes.fetch_add(size, memory_order_relaxed);
+    void* block = malloc(size == 0 ? 1 : size);
+    if (block == nullptr) throw bad_alloc();
+    return block;
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    free(block);
+}
+
+#pragma GCC diagnostic pop
+
+AllocationCounts getAllocationCounts() {
+    AllocationCounts counts;
+    counts.count = allocationCount.load(memory_order_relaxed);
+    counts.bytes = allocationBytes.load(memory_order_relaxed);
+    return counts;
+}
+
+/**
+ * Function: measureBenchmark
+ * --------------------------
+ * The first call, untimed, also sizes the batches: as many iterations as
+ * fit in kSampleSeconds, and at least one.
+ */
+BenchmarkResult measureBenchmark(const BenchmarkCase& benchmark, int samples) {
+    typedef chrono::steady_clock Clock;
+    function<void()> operation = benchmark.prepare();
+
+    auto startTime = Clock::now();
+    operation();
+    double warmupSeconds = chrono::duration<double>(Clock::now() - startTime).count();
+    long long iterations = 1;
+    if (warmupSeconds < kSampleSeconds) {
+        iterations = min(kMaxIterations, (long long) (kSampleSeconds / max(warmupSeconds, 1e-9)));
+    }
+
+    vector<double> times;
+    AllocationCounts before = getAllocationCounts();
+    for (int sample = 0; sample < samples; sample++) {
+        startTime = Clock::now();
+        for (long long i = 0; i < iterations; i++) {
+            operation();
+        }
+        double seconds = chrono::duration<double>(Clock::now() - startTime).count();
+        times.push_back(seconds * 1e9 / iterations);
+    }
+    AllocationCounts after = getAllocationCounts();
+
+    BenchmarkResult result;
+    result.name = benchmark.name;
+    result.size = benchmark.size;
+    result.samples = samples;
+    result.iterations = iterations;
+    result.medianNs = getMedian(times);
+    vector<double> deviations;
+    for (double time : times) {
+        deviations.push_back(abs(time - result.medianNs));
+    }
+    result.spreadNs = getMedian(deviations);
+    result.minNs = *min_element(times.begin(), times.end());
+    result.maxNs = *max_element(times.begin(), times.end());
+    double operations = (double) samples * iterations;
+    result.allocationsPerOp = (after.count - before.count) / operations;
+    result.bytesPerOp = (after.bytes - before.bytes) / operations;
+    return result;
+}
+
+/**
+ * Function: getMedian
+ * -------------------
+ * Return the median of the values, the mean of the middle two for an even
+ * count.
+ */
+static double getMedian(vector<double> values) {
+    sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    if (values.size() % 2 == 1) return values[middle];
+    return (values[middle - 1] + values[middle]) / 2;
+}
+
+/**
+ * Function: writeBenchmarkJson
+ * ----------------------------
+ * The names are identifiers, so they need no escaping.
+ */
+void writeBenchmarkJson(ostream& out, const string& program, const Vector<BenchmarkResult>& results) {
+    out << "{\"program\": \"" << program << "\", \"benchmarks\": [" << endl;
+    for (int i = 0; i < results.size(); i++) {
+        const BenchmarkResult& result = results[i];
+        out << fixed << setprecision(1)
+            << "  {\"name\": \"" << result.name << "\", \"size\": " << result.size
+            << ", \"samples\": " << result.samples << ", \"iterations\": " << result.iterations
+            << ", \"median_ns\": " << result.medianNs << ", \"spread_ns\": " << result.spreadNs
+            << ", \"min_ns\": " << result.minNs << ", \"max_ns\": " << result.maxNs
+            << setprecision(2) << ", \"allocations_per_op\": " << result.allocationsPerOp
+            << ", \"bytes_per_op\": " << result.bytesPerOp << "}"
+            << (i + 1 < results.size() ? "," : "") << endl;
+    }
+    out << "]}" << endl;
+}
+
+/**
+ * Function: runBenchmarks
+ * -----------------------
+ * Parse the arguments, then run and report the cases one at a time.
+ */
+int runBenchmarks(const string& program, const Vector<BenchmarkCase>& cases, int argc, char** argv) {
+    string jsonPath;
+    string filter;
+    int samples = kDefaultSamples;
+    for (int i = 1; i < argc; i++) {
+        string argument = argv[i];
+        if (argument == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (argument == "--samples" && i + 1 < argc) {
+            samples = max(1, atoi(argv[++i]));
+        } else if (argument.empty() || argument[0] != '-') {
+            filter = argument;
+        } else {
+            cerr << "Usage: " << argv[0] << " [--json <file>] [--samples <n>] [filter]" << endl;
+            return 2;
+        }
+    }
+
+    Vector<BenchmarkResult> results;
+    cout << left << setw(28) << "case" << right << setw(8) << "size" << setw(14) << "median us"
+         << setw(12) << "spread" << setw(14) << "min us" << setw(14) << "max us" << setw(12) << "allocs/op"
+         << setw(14) << "bytes/op" << endl;
+    for (const BenchmarkCase& benchmark : cases) {
+        if (!filter.empty() && benchmark.name.find(filter) == string::npos) continue;
+        BenchmarkResult result = measureBenchmark(benchmark, samples);
+        results.add(result);
+        cout << left << setw(28) << result.name << right << setw(8) << result.size << fixed << setprecision(2)
+             << setw(14) << result.medianNs / 1000 << setw(11) << result.spreadNs / result.medianNs * 100 << "%"
+             << setw(14) << result.minNs / 1000 << setw(14) << result.maxNs / 1000
+             << setprecision(1) << setw(12) << result.allocationsPerOp << setw(14) << result.bytesPerOp << endl;
+    }
+
+    if (!jsonPath.empty()) {
+        ofstream output(jsonPath);
+        writeBenchmarkJson(output, program, results);
+        output.close();
+        if (output.fail()) {
+            error("Unable to write the benchmark results \"" + jsonPath + "\"");
+        }
+    }
+    return 0;
+}
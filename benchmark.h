@@ -0,0 +1,111 @@
+/**
+ * File: benchmark.h
+ * -----------------
+ * Defines the harness shared by the benchmark drivers, one per program.
+ * A driver defines BENCHMARK and includes its program's .cpp, which leaves
+ * out the program's interactive main, then hands a list of cases to
+ * runBenchmarks.  Every case builds its inputs from a fixed seed, so two
+ * builds measure exactly the same work.  A driver is built from itself and
+ * benchmark.cpp against the Stanford library and pthread, adding
+ * dictionary-image.cpp for the ladder and boggle drivers:
+ *
+ *     g++ -std=c++17 -O2 -Wall -Wextra -I<stanford>/include \
+ *         life-benchmark.cpp benchmark.cpp -o life-benchmark \
+ *         -L<stanford>/lib -lStanfordCPPLib -lpthread
+ *
+ * and the same for maze, sentence, recursion and schedule, or ladder and
+ * boggle with dictionary-image.cpp.  It is then run as
+ *
+ *     life-benchmark [--json results.json] [--samples n] [filter]
+ *
+ * The table goes to cout and the JSON, one case per line so runs of two
+ * builds diff cleanly, to the file.
+ */
+
+#ifndef _benchmark_h
+#define _benchmark_h
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include "vector.h"
+
+/**
+ * Type: BenchmarkCase
+ * -------------------
+ * One function at one input size.  prepare builds the inputs outside the
+ * timed region and returns the operation to time, which must leave them
+ * ready for the next call.
+ */
+struct BenchmarkCase {
+    std::string name;
+    int size;
+    std::function<std::function<void()>()> prepare;
+};
+
+/**
+ * Type: BenchmarkResult
+ * ---------------------
+ * The timings of one case.  Each sample times a batch of iterations long
+ * enough for the clock; the spread is the median absolute deviation of
+ * the samples from their median.
+ */
+struct BenchmarkResult {
+    std::string name;
+    int size = 0;
+    int samples = 0;
+    long long iterations = 0;   // per sample
+    double medianNs = 0;        // all times are per operation
+    double spreadNs = 0;
+    double minNs = 0;
+    double maxNs = 0;
+    double allocationsPerOp = 0;
+    double bytesPerOp = 0;
+};
+
+/**
+ * Type: AllocationCounts
+ * ----------------------
+ * The heap allocations made through operator new by every thread since
+ * the program started.
+ */
+struct AllocationCounts {
+    long long count = 0;
+    long long bytes = 0;
+};
+
+/**
+ * Function: getAllocationCounts
+ * Usage: AllocationCounts before = getAllocationCounts();
+ * -------------------------------------------------------
+ * Returns the allocations so far; subtract two readings for a region.
+ */
+AllocationCounts getAllocationCounts();
+
+/**
+ * Function: measureBenchmark
+ * Usage: BenchmarkResult result = measureBenchmark(benchmark, 11);
+ * ----------------------------------------------------------------
+ * Prepares the case, warms it up and times the given number of samples.
+ */
+BenchmarkResult measureBenchmark(const BenchmarkCase& benchmark, int samples);
+
+/**
+ * Function: writeBenchmarkJson
+ * Usage: writeBenchmarkJson(out, "life", results);
+ * ------------------------------------------------
+ * Writes the results as a JSON object with one case per line.
+ */
+void writeBenchmarkJson(std::ostream& out, const std::string& program, const Vector<BenchmarkResult>& results);
+
+/**
+ * Function: runBenchmarks
+ * Usage: return runBenchmarks("life", cases, argc, argv);
+ * -------------------------------------------------------
+ * Runs the cases whose name contains the filter argument, if any, prints
+ * a table and writes the JSON file named by --json.  Returns the exit
+ * status for main.
+ */
+int runBenchmarks(const std::string& program, const Vector<BenchmarkCase>& cases, int argc, char** argv);
+
+#endif
@@ -0,0 +1,39 @@
+/**
+ * File: boggle-benchmark.cpp
+ * --------------------------
+ * Times getValidWords on boards from 4x4 up to 16x16, each cube showing a
+ * face of the standard cubes chosen from a fixed seed.
+ *
+ *     boggle-benchmark [--json results.json] [--samples n] [filter]
+ */
+
+#define BENCHMARK
+#include <memory>
+#include "assignment#3-boggle.cpp"
+#include "benchmark.h"
+
+static const int kBoardDimensions[] = {4, 5, 8, 16};
+static const unsigned kSeed = 1972;
+
+/**
+ * Function: main
+ * --------------
+ * Maps the dictionary once and runs every board size.
+ */
+int main(int argc, char** argv) {
+    auto dictionary = make_shared<Dictionary>(loadDictionary(kImagePath, wordsPath));
+    Vector<BenchmarkCase> cases;
+    for (int dimension : kBoardDimensions) {
+        cases.add({"getValidWords", dimension, [dictionary, dimension]() {
+            mt19937 engine(kSeed);
+            string topChars;
+            for (int cell = 0; cell < dimension * dimension; cell++) {
+                topChars += kStandardCubes[cell % 16][engine() % 6];
+            }
+            return function<void()>([dictionary, dimension, topChars]() {
+                getValidWords(*dictionary, dimension, topChars);
+            });
+        }});
+    }
+    return runBenchmarks("boggle", cases, argc, argv);
+}
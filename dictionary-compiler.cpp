@@ -0,0 +1,146 @@
+/**
+ * File: dictionary-compiler.cpp
+ * -----------------------------
+ * Compiles a text dictionary into the binary image the Boggle and word
+ * ladder programs map at start-up, or checks an image against its text.
+ *
+ *     dictionary-compiler res/dictionary.txt res/dictionary.dawg
+ *     dictionary-compiler --validate res/dictionary.txt res/dictionary.dawg
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "dictionary-image.h"
+#include "error.h"
+#include "vector.h"
+using namespace std;
+
+static int compileImage(const string& textPath, const string& imagePath);
+static int validateImage(const string& textPath, const string& imagePath);
+static void enumerateWords(const Dictionary& dictionary, int node, string& prefix, vector<string>& words);
+
+/**
+ * Function: main
+ * --------------
+ * Compiles or validates, as the arguments ask, and returns 0 on success.
+ */
+int main(int argc, char** argv) {
+    if (argc == 3) {
+        return compileImage(argv[1], argv[2]);
+    }
+    if (argc == 4 && string(argv[1]) == "--validate") {
+        return validateImage(argv[2], argv[3]);
+    }
+    cerr << "Usage: " << argv[0] << " [--validate] <words.txt> <image>" << endl;
+    return 2;
+}
+
+/**
+ * Function: compileImage
+ * --------------------
+ * Write the image of the text dictionary, with its word table.
+ */
+static int compileImage(const string& textPath, const string& imagePath) {
+    string image = compileDictionaryImage(readDictionaryText(textPath), true);
+    ofstream output(imagePath, ios::binary);
+    output.write(image.data(), image.size());
+    output.close();
+    if (output.fail()) {
+        error("Unable to write the dictionary image \"" + imagePath + "\"");
+    }
+
+    Dictionary dictionary = openDictionaryImage(shared_ptr<const char>(image.data(), [](const char*) {}),
+                                                image.size());
+    cout << dictionary.wordCount << " words, " << dictionary.nodeCount << " nodes, " << dictionary.edgeCount
+         << " edges, " << image.size() << " bytes" << endl;
+    return 0;
+}
+
+/**
+ * Function: validateImage
+ * --------------------
+ * Check the image against the text: the DAWG holds exactly the text's
+ * words, each at its index in the sorted word table, and the length
+ * buckets group every word once.  Returns 1 and reports the first
+ * problem if there is one.
+ */
+static int validateImage(const string& textPath, const string& imagePath) {
+    Dictionary dictionary = loadDictionaryImage(imagePath);
+    Vector<string> text = readDictionaryText(textPath);
+    vector<string> expected(text.begin(), text.end());
+    sort(expected.begin(), expected.end());
+    expected.erase(unique(expected.begin(), expected.end()), expected.end());
+
+    auto fail = [](const string& message) {
+        cerr << "Invalid image: " << message << endl;
+        return 1;
+    };
+    if (dictionary.wordStarts == nullptr) return fail("it has no word table");
+    if (dictionary.wordCount != (int) expected.size()) {
+        return fail(to_string(dictionary.wordCount) + " words, the text has " + to_string(expected.size()));
+    }
+
+    // Every word of the text leads to its own index in the table
+    for (int id = 0; id < (int) expected.size(); id++) {
+        const string& word = expected[id];
+        if (getDictionaryWord(dictionary, id) != word) {
+            return fail("word " + to_string(id) + " of the table is not \"" + word + "\"");
+        }
+        int node = 0;
+        int rank = 0;
+        for (char c : word) {
+            node = getDawgChild(dictionary, node, c, rank);
+            if (node == -1) break;
+        }
+        if (node == -1 || !isDawgWord(dictionary, node)) return fail("\"" + word + "\" is missing");
+        if (rank != id) return fail("\"" + word + "\" has rank " + to_string(rank) + ", not " + to_string(id));
+    }
+
+    // And the DAWG holds nothing else
+    vector<string> spelled;
+    string prefix;
+    enumerateWords(dictionary, 0, prefix, spelled);
+    if (spelled != expected) return fail("the DAWG spells words that aren't in the text");
+
+    // Every word is in the bucket of its length, in order
+    vector<bool> isBucketed(dictionary.wordCount, false);
+    for (int length = 0; length <= dictionary.maxLength; length++) {
+        int previous = -1;
+        for (uint32_t i = dictionary.bucketStarts[length]; i < dictionary.bucketStarts[length + 1]; i++) {
+            int id = dictionary.bucketWords[i];
+            if (id <= previous || id >= dictionary.wordCount || isBucketed[id]
+                    || (int) expected[id].length() != length) {
+                return fail("length bucket " + to_string(length) + " is wrong");
+            }
+            isBucketed[id] = true;
+            previous = id;
+        }
+    }
+    if (dictionary.bucketStarts[dictionary.maxLength + 1] != (uint32_t) dictionary.wordCount) {
+        return fail("the length buckets don't hold every word");
+    }
+
+    cout << "The image matches " << textPath << ": " << dictionary.wordCount << " words, "
+         << dictionary.nodeCount << " nodes" << endl;
+    return 0;
+}
+
+/**
+ * Function: enumerateWords
+ * --------------------
+ * Spell out every word below the node, in sorted order.
+ */
+static void enumerateWords(const Dictionary& dictionary, int node, string& prefix, vector<string>& words) {
+    if (isDawgWord(dictionary, node)) words.push_back(prefix);
+    for (int symbol = 0; symbol < kDawgSymbols; symbol++) {
+        char letter = 'A' + symbol;
+        int child = getDawgChild(dictionary, node, letter);
+        if (child == -1) continue;
+        prefix += letter;
+        enumerateWords(dictionary, child, prefix, words);
+        prefix.pop_back();
+    }
+}
@@ -0,0 +1,394 @@
+/**
+ * File: dictionary-image.cpp
+ * --------------------------
+ * Implements the binary dictionary image: compiling the words into a
+ * minimised DAWG with its word table and length buckets, and mapping an
+ * image back in.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>     // for open
+#include <sys/mman.h>  // for mmap
+#include <sys/stat.h>  // for fstat
+#include <unistd.h>    // for close
+#include "dictionary-image.h"
+#include "error.h"
+#include "strlib.h"
+using namespace std;
+
+static const char kImageMagic[8] = {'D', 'A', 'W', 'G', 'I', 'M', 'G', '1'};
+
+/**
+ * Type: TrieBuilder
+ * -----------------
+ * The plain trie the DAWG is minimised from.  A node's children are
+ * stored next to each other in letter order, after their parent.
+ */
+struct TrieBuilder {
+    vector<uint32_t> childMask;
+    vector<uint32_t> firstChild;
+    vector<uint32_t> wordCount;     // words in the node's subtree, itself included
+};
+
+// Fill in the node for the sorted words [low, high) that share their first depth letters
+static void buildTrieNode(TrieBuilder& trie, const vector<string>& words, int node, int low, int high, int depth) {
+    // The sorted order puts the word equal to the prefix itself first
+    uint32_t childMask = 0;
+    if (low < high && (int) words[low].length() == depth) {
+        childMask |= kDawgWordBit;
+        low++;
+    }
+
+    // Group the rest by the letter at this depth
+    vector<int> groupStarts;
+    for (int i = low; i < high; i++) {
+        uint32_t bit = 1u << (words[i][depth] - 'A');
+        if (!(childMask & bit)) {
+            childMask |= bit;
+            groupStarts.push_back(i);
+        }
+    }
+    groupStarts.push_back(high);
+
+    // Give the children a contiguous block, then fill each of them in
+    int firstChild = trie.childMask.size();
+    int childCount = groupStarts.size() - 1;
+    trie.childMask[node] = childMask;
+    trie.firstChild[node] = firstChild;
+    trie.childMask.resize(firstChild + childCount, 0);
+    trie.firstChild.resize(firstChild + childCount, 0);
+    trie.wordCount.resize(firstChild + childCount, 0);
+
+    uint32_t wordCount = (childMask & kDawgWordBit) ? 1 : 0;
+    for (int i = 0; i < childCount; i++) {
+        buildTrieNode(trie, words, firstChild + i, groupStarts[i], groupStarts[i + 1], depth + 1);
+        wordCount += trie.wordCount[firstChild + i];
+    }
+    trie.wordCount[node] = wordCount;
+}
+
+/**
+ * Type: UniqueNodes
+ * -----------------
+ * The distinct nodes found so far while minimising, each one a letter
+ * mask and the distinct ids of its children.  The hash set holds their
+ * ids and compares them through these arrays, so it stores no keys.
+ */
+struct UniqueNodes {
+    vector<uint32_t> childMask;
+    vector<uint32_t> childStart;    // children of unique node u are children[childStart[u]] up to childStart[u + 1]
+    vector<uint32_t> children;
+};
+
+struct UniqueNodeHash {
+    const UniqueNodes* nodes;
+    size_t operator()(uint32_t id) const {
+        size_t hash = nodes->childMask[id];
+        for (uint32_t i = nodes->childStart[id]; i < nodes->childStart[id + 1]; i++) {
+            hash = hash * 1000003 ^ nodes->children[i];
+        }
+        return hash;
+    }
+};
+
+struct UniqueNodeEqual {
+    const UniqueNodes* nodes;
+    bool operator()(uint32_t a, uint32_t b) const {
+        uint32_t aStart = nodes->childStart[a];
+        uint32_t bStart = nodes->childStart[b];
+        uint32_t aCount = nodes->childStart[a + 1] - aStart;
+        return nodes->childMask[a] == nodes->childMask[b]
+            && aCount == nodes->childStart[b + 1] - bStart
+            && equal(nodes->children.begin() + aStart, nodes->children.begin() + aStart + aCount,
+                     nodes->children.begin() + bStart);
+    }
+};
+
+// Append a section at the next multiple of 8 bytes and return its offset
+static uint64_t appendSection(string& image, const void* data, size_t size) {
+    image.resize((image.size() + 7) / 8 * 8, '\0');
+    uint64_t offset = image.size();
+    image.append((const char*) data, size);
+    return offset;
+}
+
+// Whether count entries of entrySize bytes at offset lie within an image of size bytes
+static bool isSectionInImage(uint64_t offset, uint64_t count, size_t entrySize, size_t size) {
+    return offset % 8 == 0 && offset <= size && count <= (size - offset) / entrySize;
+}
+
+// Whether the count starts begin at 0 and never go back
+static bool areStartsInOrder(const uint32_t* starts, uint64_t count) {
+    if (starts[0] != 0) return false;
+    for (uint64_t i = 1; i < count; i++) {
+        if (starts[i] < starts[i - 1]) return false;
+    }
+    return true;
+}
+
+// Whether every edge leads to a later node and the rank offsets count exactly the words
+// before each child, so any path spells in-range ranks; children follow their parent
+static bool isDawgConsistent(const DawgNode* nodes, uint32_t nodeCount, const DawgEdge* edges,
+                             uint32_t edgeCount, uint32_t wordCount) {
+    const uint32_t letterMask = (1u << kDawgSymbols) - 1;
+    vector<uint64_t> wordsBelow(nodeCount, 0);
+    for (int64_t node = (int64_t) nodeCount - 1; node >= 0; node--) {
+        uint32_t childMask = nodes[node].childMask;
+        uint64_t first = nodes[node].firstEdge;
+        uint64_t last = first + bitset<32>(childMask & letterMask).count();
+        if ((childMask & ~(letterMask | kDawgWordBit)) != 0 || last > edgeCount) return false;
+        uint64_t rank = (childMask & kDawgWordBit) ? 1 : 0;
+        for (uint64_t i = first; i < last; i++) {
+            const DawgEdge& edge = edges[i];
+            if (edge.target <= node || edge.target >= nodeCount || edge.rankOffset != rank) return false;
+            rank += wordsBelow[edge.target];
+        }
+        wordsBelow[node] = min(rank, (uint64_t) wordCount + 1);
+    }
+    return wordsBelow[0] == wordCount;
+}
+
+string compileDictionaryImage(Vector<string> words, bool hasWordTable) {
+    vector<string> sortedWords(words.begin(), words.end());
+    for (const string& word : sortedWords) {
+        if (word.empty()) error("The dictionary can't hold an empty word");
+        for (char c : word) {
+            if ((unsigned) ((unsigned char) c - 'A') >= (unsigned) kDawgSymbols) {
+                error("The word \"" + word + "\" has a character the dictionary can't hold");
+            }
+        }
+    }
+    sort(sortedWords.begin(), sortedWords.end());
+    sortedWords.erase(unique(sortedWords.begin(), sortedWords.end()), sortedWords.end());
+
+    TrieBuilder trie;
+    trie.childMask.push_back(0);
+    trie.firstChild.push_back(0);
+    trie.wordCount.push_back(0);
+    buildTrieNode(trie, sortedWords, 0, 0, sortedWords.size(), 0);
+
+    // Minimise: children come after their parent, so walking backwards meets
+    // every child before its parent and can merge the equivalent ones
+    int trieSize = trie.childMask.size();
+    vector<uint32_t> uniqueId(trieSize);
+    vector<uint32_t> representative;    // a trie node of every unique node
+    UniqueNodes unique;
+    unique.childStart.push_back(0);
+    unordered_set<uint32_t, UniqueNodeHash, UniqueNodeEqual> seen(16, UniqueNodeHash{&unique},
+                                                                   UniqueNodeEqual{&unique});
+    for (int node = trieSize - 1; node >= 0; node--) {
+        uint32_t candidate = representative.size();
+        int childCount = bitset<32>(trie.childMask[node] & ~kDawgWordBit).count();
+        unique.childMask.push_back(trie.childMask[node]);
+        for (int i = 0; i < childCount; i++) {
+            unique.children.push_back(uniqueId[trie.firstChild[node] + i]);
+        }
+        unique.childStart.push_back(unique.children.size());
+
+        auto found = seen.find(candidate);
+        if (found != seen.end()) {
+            uniqueId[node] = *found;
+            unique.childMask.pop_back();
+            unique.children.resize(unique.childStart[candidate]);
+            unique.childStart.pop_back();
+        } else {
+            uniqueId[node] = candidate;
+            representative.push_back(node);
+            seen.insert(candidate);
+        }
+    }
+
+    // Number the unique nodes backwards, so the root becomes node 0
+    int nodeCount = representative.size();
+    vector<DawgNode> nodes;
+    vector<DawgEdge> edges;
+    for (int id = 0; id < nodeCount; id++) {
+        int node = representative[nodeCount - 1 - id];
+        nodes.push_back({(uint32_t) edges.size(), trie.childMask[node]});
+        uint32_t rankOffset = (trie.childMask[node] & kDawgWordBit) ? 1 : 0;
+        int childCount = bitset<32>(trie.childMask[node] & ~kDawgWordBit).count();
+        for (int i = 0; i < childCount; i++) {
+            int child = trie.firstChild[node] + i;
+            edges.push_back({(uint32_t) (nodeCount - 1 - uniqueId[child]), rankOffset});
+            rankOffset += trie.wordCount[child];
+        }
+    }
+
+    // The sorted word table, and the word ids grouped by length
+    int maxLength = 0;
+    for (const string& word : sortedWords) {
+        maxLength = max(maxLength, (int) word.length());
+    }
+    vector<uint32_t> wordStarts;
+    string wordChars;
+    vector<uint32_t> bucketStarts(maxLength + 2, 0);
+    vector<uint32_t> bucketWords(sortedWords.size());
+    if (hasWordTable) {
+        for (const string& word : sortedWords) {
+            wordStarts.push_back(wordChars.size());
+            wordChars += word;
+            bucketStarts[word.length() + 1]++;
+        }
+        wordStarts.push_back(wordChars.size());
+        for (int length = 1; length <= maxLength + 1; length++) {
+            bucketStarts[length] += bucketStarts[length - 1];
+        }
+        vector<uint32_t> next(bucketStarts.begin(), bucketStarts.end() - 1);
+        for (int id = 0; id < (int) sortedWords.size(); id++) {
+            bucketWords[next[sortedWords[id].length()]++] = id;
+        }
+    }
+
+    DictionaryHeader header = {};
+    memcpy(header.magic, kImageMagic, sizeof(header.magic));
+    header.nodeCount = nodeCount;
+    header.edgeCount = edges.size();
+    header.wordCount = sortedWords.size();
+    header.maxLength = maxLength;
+
+    string image((const char*) &header, sizeof(header));
+    header.nodesOffset = appendSection(image, nodes.data(), nodes.size() * sizeof(DawgNode));
+    header.edgesOffset = appendSection(image, edges.data(), edges.size() * sizeof(DawgEdge));
+    if (hasWordTable) {
+        header.wordStartsOffset = appendSection(image, wordStarts.data(), wordStarts.size() * sizeof(uint32_t));
+        header.wordCharsOffset = appendSection(image, wordChars.data(), wordChars.size());
+        header.bucketStartsOffset = appendSection(image, bucketStarts.data(), bucketStarts.size() * sizeof(uint32_t));
+        header.bucketWordsOffset = appendSection(image, bucketWords.data(), bucketWords.size() * sizeof(uint32_t));
+    }
+    header.fileSize = image.size();
+    memcpy(&image[0], &header, sizeof(header));
+    return image;
+}
+
+Dictionary openDictionaryImage(shared_ptr<const char> bytes, size_t size) {
+    DictionaryHeader header;
+    if (size < sizeof(header)) error("The dictionary image is too short");
+    memcpy(&header, bytes.get(), sizeof(header));
+    if (memcmp(header.magic, kImageMagic, sizeof(header.magic)) != 0) {
+        error("This isn't a dictionary image, or it was written by another version");
+    }
+    if (header.fileSize != size || header.nodeCount == 0
+            || !isSectionInImage(header.nodesOffset, header.nodeCount, sizeof(DawgNode), size)
+            || !isSectionInImage(header.edgesOffset, header.edgeCount, sizeof(DawgEdge), size)) {
+        error("The dictionary image is truncated or corrupt");
+    }
+
+    Dictionary dictionary;
+    const char* base = bytes.get();
+    dictionary.nodes = (const DawgNode*) (base + header.nodesOffset);
+    dictionary.edges = (const DawgEdge*) (base + header.edgesOffset);
+    if (!isDawgConsistent(dictionary.nodes, header.nodeCount, dictionary.edges, header.edgeCount,
+                          header.wordCount)) {
+        error("The dictionary image is truncated or corrupt");
+    }
+    if (header.wordStartsOffset != 0) {
+        // the starts are checked in order, so every word and bucket lies within its section
+        uint64_t startCount = (uint64_t) header.wordCount + 1;
+        uint64_t bucketCount = (uint64_t) header.maxLength + 2;
+        if (!isSectionInImage(header.wordStartsOffset, startCount, sizeof(uint32_t), size)
+                || !isSectionInImage(header.bucketStartsOffset, bucketCount, sizeof(uint32_t), size)
+                || !isSectionInImage(header.bucketWordsOffset, header.wordCount, sizeof(uint32_t), size)) {
+            error("The dictionary image is truncated or corrupt");
+        }
+        const uint32_t* wordStarts = (const uint32_t*) (base + header.wordStartsOffset);
+        const uint32_t* bucketStarts = (const uint32_t*) (base + header.bucketStartsOffset);
+        if (!areStartsInOrder(wordStarts, startCount)
+                || !isSectionInImage(header.wordCharsOffset, wordStarts[header.wordCount], 1, size)
+                || !areStartsInOrder(bucketStarts, bucketCount)
+                || bucketStarts[bucketCount - 1] != header.wordCount) {
+            error("The dictionary image is truncated or corrupt");
+        }
+        const uint32_t* bucketWords = (const uint32_t*) (base + header.bucketWordsOffset);
+        for (uint32_t i = 0; i < header.wordCount; i++) {
+            if (bucketWords[i] >= header.wordCount) error("The dictionary image is truncated or corrupt");
+        }
+        dictionary.wordStarts = wordStarts;
+        dictionary.wordChars = base + header.wordCharsOffset;
+        dictionary.bucketStarts = bucketStarts;
+        dictionary.bucketWords = bucketWords;
+    }
+    dictionary.nodeCount = header.nodeCount;
+    dictionary.edgeCount = header.edgeCount;
+    dictionary.wordCount = header.wordCount;
+    dictionary.maxLength = header.maxLength;
+    dictionary.image = bytes;
+    dictionary.imageSize = size;
+    return dictionary;
+}
+
+Dictionary loadDictionaryImage(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd != -1 && fstat(fd, &info) == -1) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd == -1) {
+        error("Unable to open the dictionary image \"" + path + "\"");
+    }
+    size_t size = info.st_size;
+    void* mapping = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error("Unable to map the dictionary image \"" + path + "\"");
+    }
+    shared_ptr<const char> bytes((const char*) mapping, [size](const char* data) {
+        munmap((void*) data, size);
+    });
+    return openDictionaryImage(bytes, size);
+}
+
+Dictionary buildDictionary(const Vector<string>& words, bool hasWordTable) {
+    shared_ptr<string> image = make_shared<string>(compileDictionaryImage(words, hasWordTable));
+    shared_ptr<const char> bytes(image, image->data());
+    return openDictionaryImage(bytes, image->size());
+}
+
+Vector<string> readDictionaryText(const string& path) {
+    ifstream input(path);
+    if (input.fail()) {
+        error("Unable to open the dictionary \"" + path + "\"");
+    }
+    Vector<string> words;
+    string word;
+    while (input >> word) {
+        bool isAlphabetic = true;
+        for (char c : word) {
+            if (!isalpha((unsigned char) c)) {
+                isAlphabetic = false;
+                break;
+            }
+        }
+        if (isAlphabetic) words.add(toUpperCase(word));
+    }
+    return words;
+}
+
+Dictionary loadDictionary(const string& imagePath, const string& textPath) {
+    if (ifstream(imagePath).good()) {
+        return loadDictionaryImage(imagePath);
+    }
+    return buildDictionary(readDictionaryText(textPath), true);
+}
+
+bool dictionaryContains(const Dictionary& dictionary, const string& word) {
+    int node = 0;
+    for (char c : word) {
+        node = getDawgChild(dictionary, node, toupper((unsigned char) c));
+        if (node == -1) return false;
+    }
+    return !word.empty() && isDawgWord(dictionary, node);
+}
+
+string getDictionaryWord(const Dictionary& dictionary, int id) {
+    if (dictionary.wordStarts == nullptr) {
+        error("The dictionary image has no word table");
+    }
+    return string(dictionary.wordChars + dictionary.wordStarts[id],
+                  dictionary.wordStarts[id + 1] - dictionary.wordStarts[id]);
+}
@@ -0,0 +1,197 @@
+/**
+ * File: dictionary-image.h
+ * ------------------------
+ * Defines the precompiled binary dictionary shared by the Boggle and word
+ * ladder programs.  The image holds a minimised DAWG of the words, the
+ * sorted word table and the words grouped by length.  It is written once
+ * by dictionary-compiler.cpp and mapped read-only with a single mmap, so
+ * every process on the host shares the same physical pages.
+ */
+
+#ifndef _dictionary_image_h
+#define _dictionary_image_h
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <bitset>
+#include "vector.h"
+
+/**
+ * Words are upper case; the symbol right after 'Z' is also allowed, so a
+ * GADDAG can use it as its separator.
+ */
+static const int kDawgSymbols = 27;
+static const uint32_t kDawgWordBit = 1u << 31;
+
+/**
+ * Type: DawgNode
+ * --------------
+ * One node of the DAWG.  Its edges are stored next to each other in
+ * letter order, starting at firstEdge, so an edge is found from the letter
+ * mask with a popcount.
+ */
+struct DawgNode {
+    uint32_t firstEdge;
+    uint32_t childMask;         // bit i: an edge for 'A' + i; kDawgWordBit: a word ends here
+};
+
+/**
+ * Type: DawgEdge
+ * --------------
+ * An edge to a child node.  rankOffset is the number of words that sort
+ * after the parent's prefix but before the child's, so adding it up along
+ * a path gives a word's index in the sorted word table.
+ */
+struct DawgEdge {
+    uint32_t target;
+    uint32_t rankOffset;
+};
+
+/**
+ * Type: DictionaryHeader
+ * ----------------------
+ * The start of an image: every section is an offset from the start of the
+ * file, aligned to 8 bytes.  The image is in the host's byte order.
+ */
+struct DictionaryHeader {
+    char magic[8];
+    uint32_t nodeCount;
+    uint32_t edgeCount;
+    uint32_t wordCount;
+    uint32_t maxLength;
+    uint64_t nodesOffset;
+    uint64_t edgesOffset;
+    uint64_t wordStartsOffset;  // wordCount + 1 entries, 0 if there is no word table
+    uint64_t wordCharsOffset;
+    uint64_t bucketStartsOffset;// maxLength + 2 entries
+    uint64_t bucketWordsOffset;
+    uint64_t fileSize;
+};
+
+/**
+ * Type: Dictionary
+ * ----------------
+ * A read-only view of an image, mapped from a file or built in memory.
+ * Copies share the same bytes, which live as long as any copy does.
+ */
+struct Dictionary {
+    const DawgNode* nodes = nullptr;
+    const DawgEdge* edges = nullptr;
+    const uint32_t* wordStarts = nullptr;   // word i is wordChars[wordStarts[i]] up to wordStarts[i + 1]
+    const char* wordChars = nullptr;
+    const uint32_t* bucketStarts = nullptr; // the words of length n are bucketWords[bucketStarts[n]] up to
+    const uint32_t* bucketWords = nullptr;  // bucketStarts[n + 1]
+    int nodeCount = 0;
+    int edgeCount = 0;
+    int wordCount = 0;
+    int maxLength = 0;
+    std::shared_ptr<const char> image;
+    size_t imageSize = 0;
+};
+
+/**
+ * Function: compileDictionaryImage
+ * Usage: string image = compileDictionaryImage(words, true);
+ * ----------------------------------------------------------
+ * Builds the image of the words, which must already be upper case.  The
+ * word table and length buckets can be left out when only the DAWG is
+ * needed.
+ */
+std::string compileDictionaryImage(Vector<std::string> words, bool hasWordTable);
+
+/**
+ * Function: openDictionaryImage
+ * Usage: Dictionary dictionary = openDictionaryImage(bytes, size);
+ * ----------------------------------------------------------------
+ * Checks the header of an image in memory and returns a view of it, or
+ * signals an error if it isn't a valid image.
+ */
+Dictionary openDictionaryImage(std::shared_ptr<const char> bytes, size_t size);
+
+/**
+ * Function: loadDictionaryImage
+ * Usage: Dictionary dictionary = loadDictionaryImage("res/dictionary.dawg");
+ * -------------------------------------------------------------------------
+ * Maps an image file read-only and returns a view of it.
+ */
+Dictionary loadDictionaryImage(const std::string& path);
+
+/**
+ * Function: buildDictionary
+ * Usage: Dictionary dictionary = buildDictionary(words, true);
+ * ------------------------------------------------------------
+ * Compiles the words into an image in memory and returns a view of it.
+ */
+Dictionary buildDictionary(const Vector<std::string>& words, bool hasWordTable);
+
+/**
+ * Function: readDictionaryText
+ * Usage: Vector<string> words = readDictionaryText("res/dictionary.txt");
+ * -----------------------------------------------------------------------
+ * Reads a text dictionary, one word per line, keeping the purely
+ * alphabetic words in upper case.
+ */
+Vector<std::string> readDictionaryText(const std::string& path);
+
+/**
+ * Function: loadDictionary
+ * Usage: Dictionary dictionary = loadDictionary(imagePath, textPath);
+ * -------------------------------------------------------------------
+ * Maps the image if it exists, otherwise compiles the text dictionary in
+ * memory.
+ */
+Dictionary loadDictionary(const std::string& imagePath, const std::string& textPath);
+
+/**
+ * Function: dictionaryContains
+ * Usage: if (dictionaryContains(dictionary, word)) ...
+ * ----------------------------------------------------
+ * Returns whether the word, in either case, is in the dictionary.
+ */
+bool dictionaryContains(const Dictionary& dictionary, const std::string& word);
+
+/**
+ * Function: getDictionaryWord
+ * Usage: string word = getDictionaryWord(dictionary, id);
+ * -------------------------------------------------------
+ * Returns the word with the given index in the sorted word table.
+ */
+std::string getDictionaryWord(const Dictionary& dictionary, int id);
+
+/**
+ * Function: getDawgChild
+ * Usage: int child = getDawgChild(dictionary, node, letter, rank);
+ * ----------------------------------------------------------------
+ * Returns the child of the node for the upper case letter, or -1.  Starting
+ * from rank 0 at the root (node 0), rank ends up as the word's index in the
+ * sorted word table when the node is a word.
+ */
+inline int getDawgChild(const Dictionary& dictionary, int node, char letter, int& rank) {
+    unsigned symbol = (unsigned char) letter - 'A';
+    if (symbol >= kDawgSymbols) return -1;
+    const DawgNode& current = dictionary.nodes[node];
+    uint32_t bit = 1u << symbol;
+    if (!(current.childMask & bit)) return -1;
+    const DawgEdge& edge = dictionary.edges[current.firstEdge
+                                            + std::bitset<32>(current.childMask & (bit - 1)).count()];
+    rank += edge.rankOffset;
+    return edge.target;
+}
+
+inline int getDawgChild(const Dictionary& dictionary, int node, char letter) {
+    int rank = 0;
+    return getDawgChild(dictionary, node, letter, rank);
+}
+
+/**
+ * Function: isDawgWord
+ * Usage: if (isDawgWord(dictionary, node)) ...
+ * --------------------------------------------
+ * Returns whether a word ends at the node.
+ */
+inline bool isDawgWord(const Dictionary& dictionary, int node) {
+    return dictionary.nodes[node].childMask & kDawgWordBit;
+}
+
+#endif
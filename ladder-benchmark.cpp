@@ -0,0 +1,42 @@
+/**
+ * File: ladder-benchmark.cpp
+ * --------------------------
+ * Times generateLadder on fixed word pairs of three to five letters, with
+ * the ladder it prints thrown away.
+ *
+ *     ladder-benchmark [--json results.json] [--samples n] [filter]
+ */
+
+#define BENCHMARK
+#include <memory>
+#include "assignment#2-ADTs-PartI-word-ladder.cpp"
+#include "benchmark.h"
+
+static const string kWordPairs[][2] = {
+    {"cat", "dog"},
+    {"work", "play"},
+    {"stone", "money"},
+};
+
+/**
+ * Function: main
+ * --------------
+ * Maps the dictionary once and runs every pair.
+ */
+int main(int argc, char** argv) {
+    auto english = make_shared<Dictionary>(loadDictionary(kEnglishLanguageImage, kEnglishLanguageDatafile));
+    Vector<BenchmarkCase> cases;
+    for (const auto& pair : kWordPairs) {
+        string start = pair[0];
+        string end = pair[1];
+        cases.add({"generateLadder", (int) start.length(), [english, start, end]() {
+            return function<void()>([english, start, end]() {
+                streambuf* console = cout.rdbuf(nullptr);
+                generateLadder(*english, start, end);
+                cout.rdbuf(console);
+                cout.clear();
+            });
+        }});
+    }
+    return runBenchmarks("word-ladder", cases, argc, argv);
+}
@@ -0,0 +1,110 @@
+/**
+ * File: life-benchmark.cpp
+ * ------------------------
+ * Times generateToNext on square colonies filled at random from a fixed
+ * seed, a third of the cells alive.  Each operation starts again from the
+ * same colony and runs kGenerations generations.  Conway's rule runs at
+ * every size; the other rules, with kernels of their own or the generic
+ * one, run at kRuleBoardSize.  generateUniverse runs the same colonies
+ * with no edges.
+ *
+ *     life-benchmark [--json results.json] [--samples n] [filter]
+ */
+
+#define BENCHMARK
+#include <memory>
+#include <random>
+#include "assignment#1-life.cpp"
+#include "benchmark.h"
+
+static const int kBoardSizes[] = {64, 256, 1024};
+static const int kGenerations = 8;
+static const int kRuleBoardSize = 256;
+static const char* const kRules[] = {"B36/S23", "B3678/S34678", "B2/S", "B34/S34"};
+static const unsigned kSeed = 19700101;
+
+/**
+ * Type: LifeBoards
+ * ----------------
+ * The starting colony and the two boards generateToNext works on.
+ */
+struct LifeBoards {
+    Grid<int> start;
+    Grid<int> current;
+    Grid<int> previous;
+};
+
+static Grid<int> makeColony(int size);
+static BenchmarkCase makeCase(const string& name, int size, LifeRule rule);
+static BenchmarkCase makeUniverseCase(int size);
+
+/**
+ * Function: main
+ * --------------
+ * Runs every board size.
+ */
+int main(int argc, char** argv) {
+    Vector<BenchmarkCase> cases;
+    for (int size : kBoardSizes) {
+        cases.add(makeCase("generateToNext", size, kConway));
+    }
+    for (const char* rule : kRules) {
+        cases.add(makeCase(string("generateToNext ") + rule, kRuleBoardSize, parseLifeRule(rule)));
+    }
+    for (int size : kBoardSizes) {
+        cases.add(makeUniverseCase(size));
+    }
+    return runBenchmarks("life", cases, argc, argv);
+}
+
+/**
+ * Function: makeCase
+ * ------------------
+ * Make the case of one rule at one board size.
+ */
+static BenchmarkCase makeCase(const string& name, int size, LifeRule rule) {
+    return {name, size, [size, rule]() {
+        auto boards = make_shared<LifeBoards>();
+        boards->start = makeColony(size);
+        return function<void()>([boards, size, rule]() {
+            boards->current = boards->start;
+            for (int generation = 0; generation < kGenerations; generation++) {
+                if (generateToNext(size, size, boards->current, boards->previous, rule)) break;
+            }
+        });
+    }};
+}
+
+/**
+ * Function: makeUniverseCase
+ * --------------------------
+ * Make the case of the unbounded colony under Conway's rule.
+ */
+static BenchmarkCase makeUniverseCase(int size) {
+    return {"generateUniverse", size, [size]() {
+        auto start = make_shared<LifeUniverse>(makeUniverse(size, size, makeColony(size)));
+        auto universe = make_shared<LifeUniverse>();
+        return function<void()>([start, universe]() {
+            *universe = *start;
+            for (int generation = 0; generation < kGenerations; generation++) {
+                if (generateUniverse(*universe, kConway)) break;
+            }
+        });
+    }};
+}
+
+/**
+ * Function: makeColony
+ * --------------------
+ * Fill a square board at random, a third of the cells alive.
+ */
+static Grid<int> makeColony(int size) {
+    Grid<int> colony(size, size);
+    mt19937 engine(kSeed);
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            colony[i][j] = engine() % 3 == 0 ? 1 : 0;
+        }
+    }
+    return colony;
+}
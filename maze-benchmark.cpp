@@ -0,0 +1,36 @@
+/**
+ * File: maze-benchmark.cpp
+ * ------------------------
+ * Times the wall choice behind generateMaze, without the animation, with
+ * the shuffle seeded the same way for every operation.
+ *
+ *     maze-benchmark [--json results.json] [--samples n] [filter]
+ */
+
+#define BENCHMARK
+#include <cstdlib>
+#include <memory>
+#include "assignment#2-ADTs-PartII-maze-generator.cpp"
+#include "benchmark.h"
+
+static const int kMazeDimensions[] = {10, 25, 50};
+static const unsigned kSeed = 1947;
+
+/**
+ * Function: main
+ * --------------
+ * Runs every maze dimension.
+ */
+int main(int argc, char** argv) {
+    Vector<BenchmarkCase> cases;
+    for (int dimension : kMazeDimensions) {
+        cases.add({"generateMaze", dimension, [dimension]() {
+            auto walls = make_shared<Vector<wall>>(createAllWalls(dimension));
+            return function<void()>([walls, dimension]() {
+                srand(kSeed);
+                chooseRemovedWalls(dimension, *walls);
+            });
+        }});
+    }
+    return runBenchmarks("maze-generator", cases, argc, argv);
+}
@@ -0,0 +1,185 @@
+/**
+ * File: recursion-benchmark.cpp
+ * -----------------------------
+ * Times the three solvers of assignment#4 on inputs generated from fixed
+ * seeds: canAllPatientsBeSeen on rosters with about a fifth more hours
+ * than needed, minCitiesForDisasterReadiness on square grids of roads,
+ * which no reduction shrinks, and minPopularVoteToWin on elections of
+ * many small districts, each worth one to three electoral votes.  The
+ * disaster solvers also run on an empty network and on stars, which the
+ * reductions solve outright, and stop with an error on a wrong answer.
+ *
+ *     recursion-benchmark [--json results.json] [--samples n] [filter]
+ */
+
+#define BENCHMARK
+#include <memory>
+#include <random>
+#include "assignment#4-Recursion-and-ADTs.cpp"
+#include "benchmark.h"
+#include "error.h"
+
+static const int kPatientCounts[] = {12, 24, 48};
+static const int kPatientsPerDoctor = 4;
+static const int kGridSides[] = {5, 7, 9};
+static const int kStarCount = 50;
+static const int kStarSize = 6;
+static const int kDistrictCounts[] = {1000, 5000, 20000};
+static const unsigned kSeed = 20161106;
+
+/**
+ * Type: Roster
+ * ------------
+ * The inputs of one scheduling problem.
+ */
+struct Roster {
+    Vector<Doctor> doctors;
+    Vector<Patient> patients;
+};
+
+static Roster makeRoster(int patientCount, unsigned seed);
+static Map<string, Set<string>> makeGridNetwork(int side);
+static Map<string, Set<string>> makeStarNetwork(int starCount, int starSize);
+static BenchmarkCase makeReducedCase(const string& name, const Map<string, Set<string>>& network, int expected);
+static Vector<State> makeElection(int districtCount, unsigned seed);
+
+/**
+ * Function: main
+ * --------------
+ * Runs every solver at every size.
+ */
+int main(int argc, char** argv) {
+    Vector<BenchmarkCase> cases;
+    for (int patientCount : kPatientCounts) {
+        cases.add({"canAllPatientsBeSeen", patientCount, [patientCount]() {
+            auto roster = make_shared<Roster>(makeRoster(patientCount, kSeed));
+            return function<void()>([roster]() {
+                Map<string, Set<string>> schedule;
+                canAllPatientsBeSeen(roster->doctors, roster->patients, schedule);
+            });
+        }});
+    }
+    for (int side : kGridSides) {
+        cases.add({"minCitiesForDisasterReadiness", side * side, [side]() {
+            auto network = make_shared<Map<string, Set<string>>>(makeGridNetwork(side));
+            return function<void()>([network]() {
+                Set<string> locations;
+                minCitiesForDisasterReadiness(*network, locations);
+            });
+        }});
+    }
+    cases.add(makeReducedCase("minCitiesForDisaster empty", {}, 0));
+    cases.add(makeReducedCase("minCitiesForDisaster stars", makeStarNetwork(kStarCount, kStarSize),
+                              kStarCount));
+    for (int districtCount : kDistrictCounts) {
+        cases.add({"minPopularVoteToWin", districtCount, [districtCount]() {
+            auto states = make_shared<Vector<State>>(makeElection(districtCount, kSeed));
+            return function<void()>([states]() {
+                minPopularVoteToWin(*states);
+            });
+        }});
+    }
+    return runBenchmarks("recursion", cases, argc, argv);
+}
+
+/**
+ * Function: makeRoster
+ * --------------------
+ * Generate patients needing one to eight hours, and a doctor for every
+ * kPatientsPerDoctor of them with hours to spare between them.
+ */
+static Roster makeRoster(int patientCount, unsigned seed) {
+    mt19937 engine(seed);
+    uniform_int_distribution<int> patientHours(1, 8);
+    Roster roster;
+    int totalHours = 0;
+    for (int i = 0; i < patientCount; i++) {
+        roster.patients.add({"Patient " + to_string(i), patientHours(engine)});
+        totalHours += roster.patients[i].hoursNeeded;
+    }
+    int doctorCount = patientCount / kPatientsPerDoctor;
+    uniform_int_distribution<int> doctorHours(totalHours * 11 / doctorCount / 10,
+                                              totalHours * 13 / doctorCount / 10);
+    for (int i = 0; i < doctorCount; i++) {
+        roster.doctors.add({"Doctor " + to_string(i), doctorHours(engine)});
+    }
+    return roster;
+}
+
+/**
+ * Function: makeGridNetwork
+ * -------------------------
+ * Build a side x side grid, every city joined to the ones next to it.
+ */
+static Map<string, Set<string>> makeGridNetwork(int side) {
+    Map<string, Set<string>> network;
+    auto name = [side](int row, int column) {
+        return "City " + to_string(row * side + column);
+    };
+    for (int row = 0; row < side; row++) {
+        for (int column = 0; column < side; column++) {
+            Set<string>& roads = network[name(row, column)];
+            if (row > 0) roads.add(name(row - 1, column));
+            if (row + 1 < side) roads.add(name(row + 1, column));
+            if (column > 0) roads.add(name(row, column - 1));
+            if (column + 1 < side) roads.add(name(row, column + 1));
+        }
+    }
+    return network;
+}
+
+/**
+ * Function: makeStarNetwork
+ * -------------------------
+ * Build starCount separate stars, each a hub joined to starSize - 1 cities.
+ */
+static Map<string, Set<string>> makeStarNetwork(int starCount, int starSize) {
+    Map<string, Set<string>> network;
+    for (int star = 0; star < starCount; star++) {
+        string hub = "Hub " + to_string(star);
+        for (int i = 1; i < starSize; i++) {
+            string city = "City " + to_string(star * starSize + i);
+            network[hub].add(city);
+            network[city].add(hub);
+        }
+    }
+    return network;
+}
+
+/**
+ * Function: makeReducedCase
+ * -------------------------
+ * Make the case of a network the reductions leave nothing of, checking
+ * first that both disaster solvers find the expected number of cities.
+ */
+static BenchmarkCase makeReducedCase(const string& name, const Map<string, Set<string>>& network, int expected) {
+    return {name, network.size(), [name, network, expected]() {
+        Set<string> locations;
+        if (minCitiesForDisasterReadiness(network, locations) != expected || locations.size() != expected
+                || !canBeMadeDisasterReady(network, expected, locations)
+                || (expected > 0 && canBeMadeDisasterReady(network, expected - 1, locations))) {
+            error("The disaster solvers got " + name + " wrong");
+        }
+        auto input = make_shared<Map<string, Set<string>>>(network);
+        return function<void()>([input]() {
+            Set<string> locations;
+            minCitiesForDisasterReadiness(*input, locations);
+        });
+    }};
+}
+
+/**
+ * Function: makeElection
+ * --------------------
+ * Generate the districts of a synthetic election.
+ */
+static Vector<State> makeElection(int districtCount, unsigned seed) {
+    mt19937 engine(seed);
+    uniform_int_distribution<int> electoral(1, 3);
+    uniform_int_distribution<int> popular(10000, 400000);
+    Vector<State> states;
+    for (int i = 0; i < districtCount; i++) {
+        states.add({"District " + to_string(i + 1), electoral(engine), popular(engine)});
+    }
+    return states;
+}
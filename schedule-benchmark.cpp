@@ -0,0 +1,170 @@
+/**
+ * File: schedule-benchmark.cpp
+ * ----------------------------
+ * Times rescheduleAfterChange on synthetic rosters of hundreds of doctors,
+ * generated from a fixed seed, next to scheduling the same rosters from
+ * scratch.  Each operation makes one change and then the change undoing
+ * it, so the roster is the same from one call to the next: a doctor calls
+ * in sick and comes back, a patient is added and leaves, or a doctor's
+ * hours are cut by a quarter and restored.  rescheduleAfterUnschedulable
+ * sends half the doctors away, which no schedule survives, and brings
+ * them back, which must place every patient again.
+ *
+ *     schedule-benchmark [--json results.json] [--samples n] [filter]
+ */
+
+#define BENCHMARK
+#include <memory>
+#include <random>
+#include "assignment#4-Recursion-and-ADTs.cpp"
+#include "benchmark.h"
+#include "error.h"
+
+static const int kDoctorCounts[] = {100, 300, 500};
+static const int kPatientsPerDoctor = 5;
+static const unsigned kSeed = 20170212;
+
+/**
+ * Type: Roster
+ * ------------
+ * A roster, its schedule and the engine choosing the next change.
+ */
+struct Roster {
+    Vector<Doctor> doctors;
+    Vector<Patient> patients;
+    Map<string, Set<string>> schedule;
+    mt19937 engine;
+    int step = 0;
+};
+
+static Roster makeRoster(int doctorCount, unsigned seed);
+static void makeChange(Roster& roster, RosterChange& change, RosterChange& undo);
+static void makeHalfAway(const Roster& roster, RosterChange& change, RosterChange& undo);
+static int countScheduled(const Map<string, Set<string>>& schedule);
+
+/**
+ * Function: main
+ * --------------
+ * Runs both ways of scheduling at every roster size.
+ */
+int main(int argc, char** argv) {
+    Vector<BenchmarkCase> cases;
+    for (int doctorCount : kDoctorCounts) {
+        cases.add({"canAllPatientsBeSeen", doctorCount, [doctorCount]() {
+            auto roster = make_shared<Roster>(makeRoster(doctorCount, kSeed));
+            return function<void()>([roster]() {
+                Map<string, Set<string>> schedule;
+                canAllPatientsBeSeen(roster->doctors, roster->patients, schedule);
+            });
+        }});
+    }
+    for (int doctorCount : kDoctorCounts) {
+        cases.add({"rescheduleAfterChange", doctorCount, [doctorCount]() {
+            auto roster = make_shared<Roster>(makeRoster(doctorCount, kSeed));
+            if (!canAllPatientsBeSeen(roster->doctors, roster->patients, roster->schedule)) {
+                error("The roster of " + to_string(doctorCount) + " doctors can't be scheduled");
+            }
+            return function<void()>([roster]() {
+                RosterChange change, undo;
+                makeChange(*roster, change, undo);
+                rescheduleAfterChange(roster->doctors, roster->patients, roster->schedule, change);
+                rescheduleAfterChange(roster->doctors, roster->patients, roster->schedule, undo);
+            });
+        }});
+    }
+    for (int doctorCount : kDoctorCounts) {
+        cases.add({"rescheduleAfterUnschedulable", doctorCount, [doctorCount]() {
+            auto roster = make_shared<Roster>(makeRoster(doctorCount, kSeed));
+            canAllPatientsBeSeen(roster->doctors, roster->patients, roster->schedule);
+            auto changes = make_shared<pair<RosterChange, RosterChange>>();
+            makeHalfAway(*roster, changes->first, changes->second);
+            if (rescheduleAfterChange(roster->doctors, roster->patients, roster->schedule, changes->first)
+                    != UNSCHEDULABLE
+                || rescheduleAfterChange(roster->doctors, roster->patients, roster->schedule, changes->second)
+                    == UNSCHEDULABLE
+                || countScheduled(roster->schedule) != roster->patients.size()) {
+                error("The doctors coming back didn't get every patient scheduled again");
+            }
+            return function<void()>([roster, changes]() {
+                rescheduleAfterChange(roster->doctors, roster->patients, roster->schedule, changes->first);
+                rescheduleAfterChange(roster->doctors, roster->patients, roster->schedule, changes->second);
+            });
+        }});
+    }
+    return runBenchmarks("schedule", cases, argc, argv);
+}
+
+/**
+ * Function: makeRoster
+ * --------------------
+ * Generate kPatientsPerDoctor patients per doctor, each needing one to
+ * eight hours, and doctors with about 30% more hours between them than
+ * needed, so most changes can be absorbed.
+ */
+static Roster makeRoster(int doctorCount, unsigned seed) {
+    Roster roster;
+    roster.engine.seed(seed);
+    uniform_int_distribution<int> patientHours(1, 8);
+    int totalHours = 0;
+    for (int i = 0; i < doctorCount * kPatientsPerDoctor; i++) {
+        roster.patients.add({"Patient " + to_string(i), patientHours(roster.engine)});
+        totalHours += roster.patients[i].hoursNeeded;
+    }
+    uniform_int_distribution<int> doctorHours(totalHours * 10 / doctorCount / 10,
+                                              totalHours * 16 / doctorCount / 10);
+    for (int i = 0; i < doctorCount; i++) {
+        roster.doctors.add({"Doctor " + to_string(i), doctorHours(roster.engine)});
+    }
+    return roster;
+}
+
+/**
+ * Function: makeChange
+ * --------------------
+ * Make the roster change of the next step and the change undoing it,
+ * cycling through a sick doctor, a new patient and a doctor whose hours
+ * are cut by a quarter.
+ */
+static void makeChange(Roster& roster, RosterChange& change, RosterChange& undo) {
+    Doctor doctor = roster.doctors[roster.engine() % roster.doctors.size()];
+    int step = roster.step++;
+    if (step % 3 == 0) {
+        change.removedDoctors.add(doctor.name);
+        undo.addedDoctors.add(doctor);
+    } else if (step % 3 == 1) {
+        Patient patient = {"New patient " + to_string(step), (int) (roster.engine() % 8) + 1};
+        change.addedPatients.add(patient);
+        undo.removedPatients.add(patient.name);
+    } else {
+        change.removedDoctors.add(doctor.name);
+        change.addedDoctors.add({doctor.name, doctor.hoursFree * 3 / 4});
+        undo.removedDoctors.add(doctor.name);
+        undo.addedDoctors.add(doctor);
+    }
+}
+
+/**
+ * Function: makeHalfAway
+ * ----------------------
+ * Make the change sending every other doctor away and the change bringing
+ * them back.
+ */
+static void makeHalfAway(const Roster& roster, RosterChange& change, RosterChange& undo) {
+    for (int i = 0; i < roster.doctors.size(); i += 2) {
+        change.removedDoctors.add(roster.doctors[i].name);
+        undo.addedDoctors.add(roster.doctors[i]);
+    }
+}
+
+/**
+ * Function: countScheduled
+ * ------------------------
+ * Return the number of patients the schedule gives a doctor.
+ */
+static int countScheduled(const Map<string, Set<string>>& schedule) {
+    int count = 0;
+    for (const string& doctor : schedule) {
+        count += schedule[doctor].size();
+    }
+    return count;
+}
@@ -0,0 +1,162 @@
+/**
+ * File: search-stats.h
+ * --------------------
+ * Defines the counters the recursive searches keep when they are built
+ * with SEARCH_STATS defined: nodes expanded, branches pruned, memo lookups
+ * and hits, the deepest level reached and the time spent in every
+ * top-level branch.  Each thread counts into its own copy, so counting
+ * takes no locks; a search that spreads over threads merges their copies
+ * into the caller's once the workers are done.  Without SEARCH_STATS the
+ * macros below expand to nothing and the searches are unchanged.
+ *
+ * After every call of an instrumented entry point the counters go to the
+ * hook, by default one JSON line on cerr:
+ *
+ *     {"search": "solveBoard", "nodes": 1874, "prunes": 5230, ...}
+ *
+ * An entry point called from inside another, on the same thread or on a
+ * worker of it, adds to the outer call's counters and reports nothing of
+ * its own, so a batch of searches reports once, as a whole; only the
+ * outermost search times its top-level branches.
+ */
+
+#ifndef _search_stats_h
+#define _search_stats_h
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Type: SearchStats
+ * -----------------
+ * The counters of one call.  branchSeconds has an entry per top-level
+ * branch, in the order they finished.
+ */
+struct SearchStats {
+    long long nodes = 0;
+    long long prunes = 0;
+    long long memoLookups = 0;
+    long long memoHits = 0;
+    int maxDepth = 0;
+    std::vector<double> branchSeconds;
+};
+
+/**
+ * Type: SearchStatsHook
+ * ---------------------
+ * Receives the counters of every call of an instrumented entry point.
+ */
+typedef void (*SearchStatsHook)(const std::string& search, const SearchStats& stats);
+
+/**
+ * Function: writeSearchStatsJson
+ * Usage: writeSearchStatsJson(cerr, "solveBoard", stats);
+ * -------------------------------------------------------
+ * Writes the counters as one line of JSON.
+ */
+inline void writeSearchStatsJson(std::ostream& out, const std::string& search, const SearchStats& stats) {
+    out << "{\"search\": \"" << search << "\", \"nodes\": " << stats.nodes << ", \"prunes\": " << stats.prunes
+        << ", \"memo_lookups\": " << stats.memoLookups << ", \"memo_hits\": " << stats.memoHits
+        << ", \"max_depth\": " << stats.maxDepth << ", \"branch_ms\": [";
+    for (size_t i = 0; i < stats.branchSeconds.size(); i++) {
+        out << (i == 0 ? "" : ", ") << stats.branchSeconds[i] * 1000;
+    }
+    out << "]}" << std::endl;
+}
+
+// The counters of this thread's current call, and how many instrumented calls it is inside
+inline thread_local SearchStats searchStats;
+inline thread_local int searchStatsNesting = 0;
+inline std::mutex searchStatsLock;
+
+inline void writeSearchStatsToConsole(const std::string& search, const SearchStats& stats) {
+    std::lock_guard<std::mutex> lock(searchStatsLock);
+    writeSearchStatsJson(std::cerr, search, stats);
+}
+
+// The hook every outermost entry point reports to
+inline SearchStatsHook searchStatsHook = writeSearchStatsToConsole;
+
+/**
+ * Function: setSearchStatsHook
+ * Usage: setSearchStatsHook(myHook);
+ * ----------------------------------
+ * Sends the counters of every later call to the hook instead, or nowhere
+ * if it is null.  Set it before starting any search.  Searches started on
+ * several threads at once call it concurrently.
+ */
+inline void setSearchStatsHook(SearchStatsHook hook) {
+    searchStatsHook = hook;
+}
+
+/**
+ * Function: mergeSearchStats
+ * Usage: mergeSearchStats(*callerStats, searchStats);
+ * ---------------------------------------------------
+ * Adds a worker thread's counters to the caller's.
+ */
+inline void mergeSearchStats(SearchStats& total, const SearchStats& part) {
+    std::lock_guard<std::mutex> lock(searchStatsLock);
+    total.nodes += part.nodes;
+    total.prunes += part.prunes;
+    total.memoLookups += part.memoLookups;
+    total.memoHits += part.memoHits;
+    total.maxDepth = std::max(total.maxDepth, part.maxDepth);
+    total.branchSeconds.insert(total.branchSeconds.end(), part.branchSeconds.begin(), part.branchSeconds.end());
+}
+
+/**
+ * Type: SearchBranchTimer
+ * -----------------------
+ * Adds the time from its construction to its destruction as a top-level
+ * branch, if it is active.
+ */
+class SearchBranchTimer {
+public:
+    explicit SearchBranchTimer(bool isActive) : isActive(isActive) {
+        if (isActive) startTime = std::chrono::steady_clock::now();
+    }
+    ~SearchBranchTimer() {
+        if (!isActive) return;
+        auto elapsed = std::chrono::steady_clock::now() - startTime;
+        searchStats.branchSeconds.push_back(std::chrono::duration<double>(elapsed).count());
+    }
+
+private:
+    bool isActive;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+#ifdef SEARCH_STATS
+
+#define SEARCH_STATS_BEGIN() (searchStatsNesting++ == 0 ? (void) (searchStats = SearchStats()) : (void) 0)
+#define SEARCH_STATS_END(search) \
+    (--searchStatsNesting == 0 && searchStatsHook != nullptr ? searchStatsHook(search, searchStats) : (void) 0)
+#define SEARCH_STATS_NODE(depth) \
+    (searchStats.nodes++, searchStats.maxDepth = std::max(searchStats.maxDepth, (int) (depth)))
+#define SEARCH_STATS_PRUNE() (searchStats.prunes++)
+#define SEARCH_STATS_MEMO(isHit) (searchStats.memoLookups++, searchStats.memoHits += (isHit) ? 1 : 0)
+#define SEARCH_STATS_BRANCH(isTopLevel) SearchBranchTimer searchBranchTimer((isTopLevel) && searchStatsNesting <= 1)
+#define SEARCH_STATS_CALLER(name) SearchStats* name = &searchStats
+#define SEARCH_STATS_WORKER_BEGIN() (searchStatsNesting++, searchStats = SearchStats())
+#define SEARCH_STATS_WORKER_END(caller) (mergeSearchStats(*(caller), searchStats), (void) searchStatsNesting--)
+
+#else
+
+#define SEARCH_STATS_BEGIN() ((void) 0)
+#define SEARCH_STATS_END(search) ((void) 0)
+#define SEARCH_STATS_NODE(depth) ((void) 0)
+#define SEARCH_STATS_PRUNE() ((void) 0)
+#define SEARCH_STATS_MEMO(isHit) ((void) 0)
+#define SEARCH_STATS_BRANCH(isTopLevel) ((void) 0)
+#define SEARCH_STATS_CALLER(name) ((void) 0)
+#define SEARCH_STATS_WORKER_BEGIN() ((void) 0)
+#define SEARCH_STATS_WORKER_END(caller) ((void) 0)
+
+#endif
+
+#endif
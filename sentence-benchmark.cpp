@@ -0,0 +1,122 @@
+/**
+ * File: sentence-benchmark.cpp
+ * ----------------------------
+ * Times generateSentence on a small weighted grammar whose start symbol
+ * expands to a fixed number of clauses, and counting, listing and drawing
+ * its derivations up to the height a whole sentence needs.  The grammar is
+ * written to a temporary file and loaded like any other; the engine is
+ * reseeded before every draw, so each operation produces the same one.
+ *
+ *     sentence-benchmark [--json results.json] [--samples n] [filter]
+ */
+
+#define BENCHMARK
+#include <cstdio>
+#include <memory>
+#include "assignment#2-ADTs-PartIII-random-sentence-generator.cpp"
+#include "benchmark.h"
+
+static const int kClauseCounts[] = {1, 16, 256};
+static const unsigned kSeed = 1957;
+static const int kDerivationDepth = 5;          // <start>, <clause>, <vp>, <np>, <adj>
+static const int kListedDerivations = 1000;
+
+static const string kClauseGrammar =
+    "<clause>\n2\n<np> <vp>.\n{2} <np> <vp> because <np> <vp>.\n\n"
+    "<np>\n3\nthe <noun>\n{2} a <adj> <noun>\n<name>\n\n"
+    "<vp>\n3\n<verb> <np>\n<verb>\n{0.5} <verb> <np> <adverb>\n\n"
+    "<noun>\n6\ncat\ndog\nprofessor\ncompiler\nbicycle\nsandwich\n\n"
+    "<adj>\n5\nsmall\n{3} green\nnoisy\npatient\nrecursive\n\n"
+    "<verb>\n5\nsees\nfollows\n{2} compiles\nignores\nadmires\n\n"
+    "<adverb>\n3\nquickly\nrarely\nagain\n\n"
+    "<name>\n3\nAda\nAlan\nGrace\n";
+
+static Grammar makeGrammar(int clauseCount);
+static DerivationCounts makeCounts(const Grammar& grammar);
+
+/**
+ * Function: main
+ * --------------
+ * Runs every clause count.
+ */
+int main(int argc, char** argv) {
+    Vector<BenchmarkCase> cases;
+    for (int clauseCount : kClauseCounts) {
+        cases.add({"generateSentence", clauseCount, [clauseCount]() {
+            auto grammar = make_shared<Grammar>(makeGrammar(clauseCount));
+            return function<void()>([grammar]() {
+                getEngine().seed(kSeed);
+                generateSentence(*grammar);
+            });
+        }});
+    }
+    for (int clauseCount : kClauseCounts) {
+        cases.add({"countDerivations", clauseCount, [clauseCount]() {
+            auto grammar = make_shared<Grammar>(makeGrammar(clauseCount));
+            return function<void()>([grammar]() {
+                countDerivations(*grammar, kDerivationDepth);
+            });
+        }});
+    }
+    for (int clauseCount : kClauseCounts) {
+        cases.add({"enumerateDerivations", clauseCount, [clauseCount]() {
+            auto grammar = make_shared<Grammar>(makeGrammar(clauseCount));
+            auto counts = make_shared<DerivationCounts>(makeCounts(*grammar));
+            return function<void()>([grammar, counts]() {
+                int listed = 0;
+                enumerateDerivations(*grammar, *counts, kDerivationDepth, [&listed](const string&) {
+                    return ++listed < kListedDerivations;
+                });
+            });
+        }});
+    }
+    for (int clauseCount : kClauseCounts) {
+        cases.add({"sampleDerivation", clauseCount, [clauseCount]() {
+            auto grammar = make_shared<Grammar>(makeGrammar(clauseCount));
+            auto counts = make_shared<DerivationCounts>(makeCounts(*grammar));
+            return function<void()>([grammar, counts]() {
+                getEngine().seed(kSeed);
+                sampleDerivation(*grammar, *counts, kDerivationDepth);
+            });
+        }});
+    }
+    return runBenchmarks("random-sentence-generator", cases, argc, argv);
+}
+
+/**
+ * Function: makeGrammar
+ * ---------------------
+ * Write the grammar with the given number of clauses and load it.  The
+ * file can go as soon as it is mapped.
+ */
+static Grammar makeGrammar(int clauseCount) {
+    string text = kStartSymbol + "\n1\n";
+    for (int i = 0; i < clauseCount; i++) {
+        text += i == 0 ? "<clause>" : " <clause>";
+    }
+    text += "\n\n" + kClauseGrammar;
+
+    char path[] = "/tmp/sentence-benchmark-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1 || write(fd, text.data(), text.size()) != (ssize_t) text.size()) {
+        error("Unable to write the benchmark grammar");
+    }
+    close(fd);
+    Grammar grammar = getDefinition(path);
+    remove(path);
+    return grammar;
+}
+
+/**
+ * Function: makeCounts
+ * --------------------
+ * Count the derivations up to kDerivationDepth, which must reach a whole
+ * sentence.
+ */
+static DerivationCounts makeCounts(const Grammar& grammar) {
+    DerivationCounts counts = countDerivations(grammar, kDerivationDepth);
+    if (counts.count[kDerivationDepth][grammar.index.get(kStartSymbol)].isZero()) {
+        error("The benchmark grammar has no derivation of height " + integerToString(kDerivationDepth));
+    }
+    return counts;
+}